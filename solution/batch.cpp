@@ -0,0 +1,70 @@
+#include "batch.h"
+
+#include <exception>
+
+using namespace seal;
+
+std::vector<double> evaluateBatched(CompiledCircuit const &circuit, std::vector<std::vector<double>> const &columns,
+                                   Encryptor const &encryptor, Decryptor &decryptor, Evaluator const &evaluator,
+                                   CKKSEncoder const &encoder, RelinKeys const *relin_keys, PlaintextCache *cache) {
+  if (columns.size() != circuit.input_count()) {
+    throw std::invalid_argument("need one column per circuit input");
+  }
+  std::size_t rows = columns.empty() ? 0 : columns[0].size();
+  for (auto const &column : columns) {
+    if (column.size() != rows) {
+      throw std::invalid_argument("all columns must have the same length");
+    }
+  }
+
+  std::size_t slot_count = encoder.slot_count();
+  std::size_t blocks = batchBlockCount(rows, encoder);
+  std::vector<double> result(rows);
+
+  // Exceptions must not leave the parallel region, so the first one is rethrown afterwards
+  std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t b = 0; b < blocks; b++) {
+    try {
+      std::size_t begin = b * slot_count;
+      std::size_t count = std::min(slot_count, rows - begin);
+
+      std::vector<Ciphertext> inputs(columns.size());
+      std::vector<double> values(slot_count, 0.0);
+      for (std::size_t j = 0; j < columns.size(); j++) {
+        std::copy(columns[j].begin() + begin, columns[j].begin() + begin + count, values.begin());
+        Plaintext plain;
+        {
+          TraceScope scope("encode", "encoder");
+          encoder.encode(values, circuit.input_scale(), plain);
+        }
+        TraceScope scope("encrypt", "encryptor");
+        encryptor.encrypt(plain, inputs[j]);
+        scope.set(inputs[j]);
+      }
+
+      Ciphertext output;
+      circuit.run(inputs, output, evaluator, encoder, relin_keys, cache);
+
+      Plaintext plain_output;
+      {
+        TraceScope scope("decrypt", "decryptor", output);
+        decryptor.decrypt(output, plain_output);
+      }
+      {
+        TraceScope scope("decode", "encoder");
+        encoder.decode(plain_output, values);
+      }
+      std::copy(values.begin(), values.begin() + count, result.begin() + begin);
+    } catch (...) {
+#pragma omp critical
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return result;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "circuit.h"
+
+/// Slot-batched evaluation of a compiled circuit on many independent rows of inputs.
+/// Row i goes into slot i % slot_count of block i / slot_count: every block packs one slot_count-tuple of rows per
+/// input, is encrypted, run through the circuit, decrypted and unpacked, and the blocks are processed in parallel.
+/// \param circuit Compiled circuit, run once per block
+/// \param columns columns[j][i] is input j of row i; one column per circuit input, all of the same length
+/// \param relin_keys Required if the circuit multiplies ciphertexts
+/// \param cache If given, the circuit constants are encoded once and shared by all blocks
+/// \return The circuit's result for every row
+/// \throws std::invalid_argument if the number or lengths of the columns do not match the circuit
+std::vector<double> evaluateBatched(CompiledCircuit const &circuit, std::vector<std::vector<double>> const &columns,
+                                   seal::Encryptor const &encryptor, seal::Decryptor &decryptor,
+                                   seal::Evaluator const &evaluator, seal::CKKSEncoder const &encoder,
+                                   seal::RelinKeys const *relin_keys = nullptr, PlaintextCache *cache = nullptr);
+
+/// Number of blocks (circuit runs) evaluateBatched needs for the given number of rows
+inline std::size_t batchBlockCount(std::size_t rows, seal::CKKSEncoder const &encoder) {
+  return (rows + encoder.slot_count() - 1) / encoder.slot_count();
+}
@@ -0,0 +1,78 @@
+#include "bulk_crypto.h"
+#include "trace.h"
+
+#include <exception>
+
+using namespace seal;
+
+void encrypt_many(Encryptor const &encryptor, Plaintext const *plains, std::size_t count, Ciphertext *destination) {
+  // Exceptions must not leave the parallel region, so the first one is rethrown afterwards
+  std::exception_ptr error;
+#pragma omp parallel
+  {
+    MemoryPoolHandle pool = MemoryManager::GetPool(mm_prof_opt::mm_force_thread_local);
+#pragma omp for schedule(static)
+    for (std::size_t i = 0; i < count; i++) {
+      try {
+        TraceScope scope("encrypt", "encryptor");
+        encryptor.encrypt(plains[i], destination[i], pool);
+        scope.set(destination[i]);
+      } catch (...) {
+#pragma omp critical
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void encrypt_many(Encryptor const &encryptor, std::vector<Plaintext> const &plains,
+                  std::vector<Ciphertext> &destination) {
+  destination.resize(plains.size());
+  encrypt_many(encryptor, plains.data(), plains.size(), destination.data());
+}
+
+void decrypt_many(SEALContext const &context, SecretKey const &secret_key, Ciphertext const *ctxts,
+                  std::size_t count, Plaintext *destination) {
+  std::exception_ptr error;
+#pragma omp parallel
+  {
+    std::unique_ptr<Decryptor> decryptor;
+    try {
+      decryptor = std::make_unique<Decryptor>(context, secret_key);
+    } catch (...) {
+#pragma omp critical
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+#pragma omp for schedule(static)
+    for (std::size_t i = 0; i < count; i++) {
+      if (!decryptor) {
+        continue;
+      }
+      try {
+        TraceScope scope("decrypt", "decryptor", ctxts[i]);
+        decryptor->decrypt(ctxts[i], destination[i]);
+      } catch (...) {
+#pragma omp critical
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void decrypt_many(SEALContext const &context, SecretKey const &secret_key, std::vector<Ciphertext> const &ctxts,
+                  std::vector<Plaintext> &destination) {
+  destination.resize(ctxts.size());
+  decrypt_many(context, secret_key, ctxts.data(), ctxts.size(), destination.data());
+}
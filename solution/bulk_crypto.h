@@ -0,0 +1,24 @@
+#pragma once
+
+#include "utils.h"
+
+/// Encrypt plains[i] into destination[i] for all i < count, split into contiguous ranges across threads.
+/// Every thread draws temporaries from its own thread-local memory pool; the encryption randomness is seeded
+/// per call by the context's random generator factory, so threads never share a random state.
+/// \param destination Preallocated array of count ciphertexts
+void encrypt_many(seal::Encryptor const &encryptor, seal::Plaintext const *plains, std::size_t count,
+                  seal::Ciphertext *destination);
+
+/// Encrypt all plaintexts; destination is resized to match
+void encrypt_many(seal::Encryptor const &encryptor, std::vector<seal::Plaintext> const &plains,
+                  std::vector<seal::Ciphertext> &destination);
+
+/// Decrypt ctxts[i] into destination[i] for all i < count, split into contiguous ranges across threads.
+/// Every thread uses its own Decryptor and with it its own memory pool.
+/// \param destination Preallocated array of count plaintexts
+void decrypt_many(seal::SEALContext const &context, seal::SecretKey const &secret_key, seal::Ciphertext const *ctxts,
+                  std::size_t count, seal::Plaintext *destination);
+
+/// Decrypt all ciphertexts; destination is resized to match
+void decrypt_many(seal::SEALContext const &context, seal::SecretKey const &secret_key,
+                  std::vector<seal::Ciphertext> const &ctxts, std::vector<seal::Plaintext> &destination);
@@ -0,0 +1,671 @@
+#include "circuit.h"
+
+#include <map>
+
+using namespace seal;
+
+namespace {
+
+// Constants that can be multiplied in at scale 1, i.e. without consuming a level
+bool is_small_integer(double value) {
+  return std::nearbyint(value) == value && std::fabs(value) <= (1 << 20);
+}
+
+// Scales that SEAL will accept as equal. Anything else differs by far more than floating-point rounding.
+bool same_scale(double a, double b) {
+  return std::fabs(a - b) <= 1e-12 * std::max(std::fabs(a), std::fabs(b));
+}
+
+char const *op_name(CircuitOp::Kind kind) {
+  switch (kind) {
+    case CircuitOp::Kind::add:return "add";
+    case CircuitOp::Kind::sub:return "sub";
+    case CircuitOp::Kind::multiply:return "multiply";
+    case CircuitOp::Kind::square:return "square";
+    case CircuitOp::Kind::negate:return "negate";
+    case CircuitOp::Kind::add_plain:return "add_plain";
+    case CircuitOp::Kind::multiply_plain:return "multiply_plain";
+    case CircuitOp::Kind::relinearize:return "relinearize";
+    case CircuitOp::Kind::rescale:return "rescale";
+    case CircuitOp::Kind::mod_switch:return "mod_switch";
+    case CircuitOp::Kind::set_scale:return "set_scale";
+  }
+  return "?";
+}
+
+// Emits the instructions of a CompiledCircuit while tracking level, scale and size of every register
+class Lowering {
+ public:
+  Lowering(SEALContext const &context, std::vector<CircuitOp> &ops, ScaleMismatch mismatch, double scale_tolerance)
+      : ops_(ops), mismatch_(mismatch), scale_tolerance_(scale_tolerance) {
+    for (auto data = context.first_context_data(); data; data = data->next_context_data()) {
+      primes_.resize(std::max(primes_.size(), data->chain_index() + 1));
+      primes_[data->chain_index()] = static_cast<double>(data->parms().coeff_modulus().back().value());
+    }
+  }
+
+  std::size_t new_register(std::size_t level, double scale, std::size_t size) {
+    CircuitOp state{CircuitOp::Kind::add, regs_.size(), regs_.size()};
+    state.level = level;
+    state.scale = scale;
+    state.size = size;
+    regs_.push_back(state);
+    return regs_.size() - 1;
+  }
+
+  CircuitOp const &reg(std::size_t r) const { return regs_[r]; }
+  std::size_t register_count() const { return regs_.size(); }
+
+  // Append an instruction; op.level/scale/size describe dst afterwards
+  std::size_t emit(CircuitOp op) {
+    if (op.dst >= regs_.size()) {
+      op.dst = new_register(op.level, op.scale, op.size);
+    }
+    regs_[op.dst].level = op.level;
+    regs_[op.dst].scale = op.scale;
+    regs_[op.dst].size = op.size;
+    ops_.push_back(op);
+    return op.dst;
+  }
+
+  CircuitOp derive(CircuitOp::Kind kind, std::size_t lhs, std::size_t rhs = 0) const {
+    CircuitOp op{kind, std::numeric_limits<std::size_t>::max(), lhs, rhs};
+    op.level = regs_[lhs].level;
+    op.scale = regs_[lhs].scale;
+    op.size = regs_[lhs].size;
+    return op;
+  }
+
+  // r mod-switched down to the given level; every (register, level) pair is only switched once
+  std::size_t at_level(std::size_t r, std::size_t level) {
+    if (regs_[r].level == level) {
+      return r;
+    }
+    auto key = std::make_pair(r, level);
+    auto it = switched_.find(key);
+    if (it != switched_.end()) {
+      return it->second;
+    }
+    auto op = derive(CircuitOp::Kind::mod_switch, r);
+    op.levels = regs_[r].level - level;
+    op.level = level;
+    return switched_[key] = emit(op);
+  }
+
+  // r at the given (strictly lower) level with exactly the given scale: multiply by 1 encoded at
+  // scale * q / scale(r) one level above, then rescale
+  std::size_t matched(std::size_t r, std::size_t level, double scale) {
+    if (same_scale(regs_[r].scale, scale)) {
+      return at_level(r, level);
+    }
+    std::size_t upper = at_level(r, level + 1);
+    auto op = derive(CircuitOp::Kind::multiply_plain, upper);
+    op.value = 1.0;
+    op.plain_scale = scale * primes_[level + 1] / regs_[upper].scale;
+    op.scale = scale * primes_[level + 1];
+    std::size_t d = emit(op);
+    return rescale(d, scale);
+  }
+
+  // Rescale r in place; target overrides the computed scale to absorb floating-point rounding
+  std::size_t rescale(std::size_t r, double target = 0) {
+    if (regs_[r].level == 0) {
+      throw std::invalid_argument("modulus chain is too short for this circuit");
+    }
+    auto op = derive(CircuitOp::Kind::rescale, r);
+    op.dst = r;
+    op.level = regs_[r].level - 1;
+    op.scale = target > 0 ? target : regs_[r].scale / primes_[regs_[r].level];
+    return emit(op);
+  }
+
+  std::size_t add(CircuitOp::Kind kind, std::size_t a, std::size_t b) {
+    std::size_t level = std::min(regs_[a].level, regs_[b].level);
+    if (same_scale(regs_[a].scale, regs_[b].scale)) {
+      a = at_level(a, level);
+      b = at_level(b, level);
+    } else if (mismatch_ == ScaleMismatch::error) {
+      throw std::invalid_argument("operands of an addition have different scales; pass ScaleMismatch::realign or "
+                                  "ScaleMismatch::set_scale to compile()");
+    } else if (mismatch_ == ScaleMismatch::set_scale
+        && std::fabs(regs_[a].scale / regs_[b].scale - 1) <= scale_tolerance_) {
+      // Deliberate approximation: relabelling b's scale scales its value by the (tolerated) mismatch
+      a = at_level(a, level);
+      b = at_level(b, level);
+      auto op = derive(CircuitOp::Kind::set_scale, b);
+      op.scale = regs_[a].scale;
+      b = emit(op);
+    } else {
+      // Bring the operand with more levels left to the scale of the other one. If both are on the same level,
+      // this costs an extra level on both sides.
+      bool a_high = regs_[a].level >= regs_[b].level;
+      std::size_t &high = a_high ? a : b;
+      std::size_t &low = a_high ? b : a;
+      if (regs_[high].level == regs_[low].level) {
+        if (level == 0) {
+          throw std::invalid_argument("modulus chain is too short for this circuit");
+        }
+        level--;
+      }
+      high = matched(high, level, regs_[low].scale);
+      low = at_level(low, level);
+    }
+    auto op = derive(kind, a, b);
+    op.size = std::max(regs_[a].size, regs_[b].size);
+    return emit(op);
+  }
+
+  std::size_t multiply(std::size_t a, std::size_t b) {
+    std::size_t level = std::min(regs_[a].level, regs_[b].level);
+    a = at_level(a, level);
+    b = at_level(b, level);
+    auto op = derive(a == b ? CircuitOp::Kind::square : CircuitOp::Kind::multiply, a, b);
+    op.scale = regs_[a].scale * regs_[b].scale;
+    op.size = 3;
+    std::size_t d = emit(op);
+    auto relin = derive(CircuitOp::Kind::relinearize, d);
+    relin.dst = d;
+    relin.size = 2;
+    emit(relin);
+    return rescale(d);
+  }
+
+  std::size_t multiply_const(std::size_t a, double value) {
+    auto op = derive(CircuitOp::Kind::multiply_plain, a);
+    op.value = value;
+    if (is_small_integer(value)) {
+      op.plain_scale = 1.0;
+      return emit(op);
+    }
+    // Encode at the prime that the following rescale divides by, so the scale is preserved
+    op.plain_scale = primes_[regs_[a].level];
+    op.scale = regs_[a].scale * op.plain_scale;
+    double scale = regs_[a].scale;
+    return rescale(emit(op), scale);
+  }
+
+  std::size_t add_const(std::size_t a, double value) {
+    auto op = derive(CircuitOp::Kind::add_plain, a);
+    op.value = value;
+    op.plain_scale = regs_[a].scale;
+    return emit(op);
+  }
+
+  std::size_t negate(std::size_t a) {
+    return emit(derive(CircuitOp::Kind::negate, a));
+  }
+
+ private:
+  std::vector<CircuitOp> &ops_;
+  ScaleMismatch mismatch_;
+  double scale_tolerance_;
+  std::vector<CircuitOp> regs_;
+  std::vector<double> primes_; // prime dropped when rescaling from each chain index
+  std::map<std::pair<std::size_t, std::size_t>, std::size_t> switched_;
+};
+
+} // namespace
+
+Expr Circuit::add_node(Node node) {
+  nodes_.push_back(node);
+  return Expr(this, nodes_.size() - 1);
+}
+
+Expr Circuit::input() {
+  Node node{Node::Kind::input};
+  node.value = static_cast<double>(input_count_++);
+  return add_node(node);
+}
+
+Expr Circuit::constant(double value) {
+  Node node{Node::Kind::constant};
+  node.value = value;
+  return add_node(node);
+}
+
+Expr operator+(Expr const &a, Expr const &b) {
+  Circuit &c = *a.circuit_;
+  if (c.is_constant(b)) {
+    return a + c.constant_value(b);
+  }
+  if (c.is_constant(a)) {
+    return b + c.constant_value(a);
+  }
+  return c.add_node({Circuit::Node::Kind::add, a.node_, b.node_});
+}
+
+Expr operator-(Expr const &a, Expr const &b) {
+  Circuit &c = *a.circuit_;
+  if (c.is_constant(b)) {
+    return a + (-c.constant_value(b));
+  }
+  if (c.is_constant(a)) {
+    return (-b) + c.constant_value(a);
+  }
+  return c.add_node({Circuit::Node::Kind::sub, a.node_, b.node_});
+}
+
+Expr operator*(Expr const &a, Expr const &b) {
+  Circuit &c = *a.circuit_;
+  if (c.is_constant(b)) {
+    return a * c.constant_value(b);
+  }
+  if (c.is_constant(a)) {
+    return b * c.constant_value(a);
+  }
+  return c.add_node({Circuit::Node::Kind::multiply, a.node_, b.node_});
+}
+
+Expr operator-(Expr const &a) {
+  Circuit &c = *a.circuit_;
+  if (c.is_constant(a)) {
+    return c.constant(-c.constant_value(a));
+  }
+  return c.add_node({Circuit::Node::Kind::negate, a.node_});
+}
+
+Expr operator+(Expr const &a, double b) {
+  Circuit &c = *a.circuit_;
+  if (c.is_constant(a)) {
+    return c.constant(c.constant_value(a) + b);
+  }
+  if (b == 0) {
+    return a;
+  }
+  Circuit::Node node{Circuit::Node::Kind::add_const, a.node_};
+  node.value = b;
+  return c.add_node(node);
+}
+
+Expr operator*(Expr const &a, double b) {
+  Circuit &c = *a.circuit_;
+  if (c.is_constant(a)) {
+    return c.constant(c.constant_value(a) * b);
+  }
+  if (b == 0) {
+    return c.constant(0);
+  }
+  if (b == 1) {
+    return a;
+  }
+  if (b == -1) {
+    return -a;
+  }
+  Circuit::Node node{Circuit::Node::Kind::multiply_const, a.node_};
+  node.value = b;
+  return c.add_node(node);
+}
+
+std::size_t Circuit::depth(Expr const &output) const {
+  std::vector<std::size_t> depths(output.node_ + 1, 0);
+  for (std::size_t i = 0; i <= output.node_; i++) {
+    auto const &node = nodes_[i];
+    switch (node.kind) {
+      case Node::Kind::input:
+      case Node::Kind::constant:depths[i] = 0;
+        break;
+      case Node::Kind::add:
+      case Node::Kind::sub:depths[i] = std::max(depths[node.lhs], depths[node.rhs]);
+        break;
+      case Node::Kind::multiply:depths[i] = std::max(depths[node.lhs], depths[node.rhs]) + 1;
+        break;
+      case Node::Kind::multiply_const:depths[i] = depths[node.lhs] + (is_small_integer(node.value) ? 0 : 1);
+        break;
+      case Node::Kind::negate:
+      case Node::Kind::add_const:depths[i] = depths[node.lhs];
+        break;
+    }
+  }
+  return depths[output.node_];
+}
+
+std::vector<double> Circuit::evaluate(Expr const &output, std::vector<std::vector<double>> const &inputs) const {
+  if (inputs.size() != input_count_) {
+    throw std::invalid_argument("need one column per circuit input");
+  }
+  std::size_t rows = inputs.empty() ? 0 : inputs[0].size();
+  for (auto const &column : inputs) {
+    if (column.size() != rows) {
+      throw std::invalid_argument("all columns must have the same length");
+    }
+  }
+
+  std::vector<std::vector<double>> values(output.node_ + 1);
+  for (std::size_t n = 0; n <= output.node_; n++) {
+    auto const &node = nodes_[n];
+    auto &v = values[n];
+    switch (node.kind) {
+      case Node::Kind::input:v = inputs[static_cast<std::size_t>(node.value)];
+        break;
+      case Node::Kind::constant:v.assign(rows, node.value);
+        break;
+      default:v.resize(rows);
+        for (std::size_t i = 0; i < rows; i++) {
+          double a = values[node.lhs][i];
+          switch (node.kind) {
+            case Node::Kind::add:v[i] = a + values[node.rhs][i];
+              break;
+            case Node::Kind::sub:v[i] = a - values[node.rhs][i];
+              break;
+            case Node::Kind::multiply:v[i] = a * values[node.rhs][i];
+              break;
+            case Node::Kind::negate:v[i] = -a;
+              break;
+            case Node::Kind::add_const:v[i] = a + node.value;
+              break;
+            case Node::Kind::multiply_const:v[i] = a * node.value;
+              break;
+            default:break;
+          }
+        }
+    }
+  }
+  return values[output.node_];
+}
+
+CompiledCircuit Circuit::compile(Expr const &output, SEALContext const &context, double scale,
+                                 ScaleMismatch mismatch, double scale_tolerance) const {
+  if (output.circuit_ != this) {
+    throw std::invalid_argument("expression does not belong to this circuit");
+  }
+  if (is_constant(output)) {
+    throw std::invalid_argument("circuit output is a constant");
+  }
+
+  // Only lower the nodes the output depends on (nodes are stored in topological order)
+  std::vector<bool> needed(output.node_ + 1, false);
+  needed[output.node_] = true;
+  for (std::size_t i = output.node_ + 1; i-- > 0;) {
+    if (needed[i] && nodes_[i].kind != Node::Kind::input && nodes_[i].kind != Node::Kind::constant) {
+      needed[nodes_[i].lhs] = true;
+      if (nodes_[i].kind == Node::Kind::add || nodes_[i].kind == Node::Kind::sub ||
+          nodes_[i].kind == Node::Kind::multiply) {
+        needed[nodes_[i].rhs] = true;
+      }
+    }
+  }
+
+  CompiledCircuit result;
+  Lowering lowering(context, result.ops_, mismatch, scale_tolerance);
+  std::size_t first_level = context.first_context_data()->chain_index();
+  for (std::size_t i = 0; i < input_count_; i++) {
+    lowering.new_register(first_level, scale, 2);
+  }
+
+  std::vector<std::size_t> regs(output.node_ + 1, 0);
+  for (std::size_t i = 0; i <= output.node_; i++) {
+    if (!needed[i]) {
+      continue;
+    }
+    auto const &node = nodes_[i];
+    switch (node.kind) {
+      case Node::Kind::input:regs[i] = static_cast<std::size_t>(node.value);
+        break;
+      case Node::Kind::constant:break; // folded into add_const / multiply_const
+      case Node::Kind::add:regs[i] = lowering.add(CircuitOp::Kind::add, regs[node.lhs], regs[node.rhs]);
+        break;
+      case Node::Kind::sub:regs[i] = lowering.add(CircuitOp::Kind::sub, regs[node.lhs], regs[node.rhs]);
+        break;
+      case Node::Kind::multiply:regs[i] = lowering.multiply(regs[node.lhs], regs[node.rhs]);
+        break;
+      case Node::Kind::negate:regs[i] = lowering.negate(regs[node.lhs]);
+        break;
+      case Node::Kind::add_const:regs[i] = lowering.add_const(regs[node.lhs], node.value);
+        break;
+      case Node::Kind::multiply_const:regs[i] = lowering.multiply_const(regs[node.lhs], node.value);
+        break;
+    }
+  }
+
+  result.register_count_ = lowering.register_count();
+  result.input_count_ = input_count_;
+  result.output_ = regs[output.node_];
+  result.depth_ = first_level - lowering.reg(result.output_).level;
+  result.input_scale_ = scale;
+  result.input_level_ = first_level;
+  result.input_parms_id_ = context.first_parms_id();
+  return result;
+}
+
+void CompiledCircuit::run(std::vector<Ciphertext> const &inputs, Ciphertext &output, Evaluator const &evaluator,
+                          CKKSEncoder const &encoder, RelinKeys const *relin_keys, PlaintextCache *cache) const {
+  if (inputs.size() != input_count_) {
+    throw std::invalid_argument("wrong number of circuit inputs");
+  }
+  for (auto const &input : inputs) {
+    if (input.parms_id() != input_parms_id_ || !same_scale(input.scale(), input_scale_)) {
+      throw std::invalid_argument("circuit inputs must be fresh ciphertexts at the compile scale");
+    }
+  }
+
+  TraceScope circuit_scope("circuit", "circuit");
+
+  // Registers below input_count_ are the inputs themselves, which are never written
+  std::vector<Ciphertext> storage(register_count_);
+  auto reg = [&](std::size_t r) -> Ciphertext const & { return r < input_count_ ? inputs[r] : storage[r]; };
+
+  for (auto const &op : ops_) {
+    Ciphertext &dst = storage[op.dst];
+    TraceScope scope(op_name(op.kind), "evaluator");
+    switch (op.kind) {
+      case CircuitOp::Kind::add:evaluator.add(reg(op.lhs), reg(op.rhs), dst);
+        break;
+      case CircuitOp::Kind::sub:evaluator.sub(reg(op.lhs), reg(op.rhs), dst);
+        break;
+      case CircuitOp::Kind::multiply:evaluator.multiply(reg(op.lhs), reg(op.rhs), dst);
+        break;
+      case CircuitOp::Kind::square:evaluator.square(reg(op.lhs), dst);
+        break;
+      case CircuitOp::Kind::negate:evaluator.negate(reg(op.lhs), dst);
+        break;
+      case CircuitOp::Kind::add_plain:
+      case CircuitOp::Kind::multiply_plain: {
+        std::shared_ptr<Plaintext const> plain;
+        if (cache) {
+          plain = cache->get(op.value, reg(op.lhs).parms_id(), op.plain_scale);
+        } else {
+          TraceScope encode_scope("encode", "encoder");
+          auto encoded = std::make_shared<Plaintext>();
+          encoder.encode(op.value, reg(op.lhs).parms_id(), op.plain_scale, *encoded);
+          plain = std::move(encoded);
+        }
+        if (op.kind == CircuitOp::Kind::add_plain) {
+          evaluator.add_plain(reg(op.lhs), *plain, dst);
+        } else {
+          evaluator.multiply_plain(reg(op.lhs), *plain, dst);
+        }
+        break;
+      }
+      case CircuitOp::Kind::relinearize:
+        if (!relin_keys) {
+          throw std::invalid_argument("circuit needs relinearization keys");
+        }
+        if (op.dst == op.lhs) {
+          evaluator.relinearize_inplace(dst, *relin_keys);
+        } else {
+          evaluator.relinearize(reg(op.lhs), *relin_keys, dst);
+        }
+        break;
+      case CircuitOp::Kind::rescale:
+        if (op.dst == op.lhs) {
+          evaluator.rescale_to_next_inplace(dst);
+        } else {
+          evaluator.rescale_to_next(reg(op.lhs), dst);
+        }
+        dst.scale() = op.scale; // only differs from the computed scale by floating-point rounding
+        break;
+      case CircuitOp::Kind::mod_switch:
+        if (op.dst != op.lhs) {
+          dst = reg(op.lhs);
+        }
+        for (std::size_t i = 0; i < op.levels; i++) {
+          evaluator.mod_switch_to_next_inplace(dst);
+        }
+        break;
+      case CircuitOp::Kind::set_scale:
+        if (op.dst != op.lhs) {
+          dst = reg(op.lhs);
+        }
+        dst.scale() = op.scale;
+        break;
+    }
+    scope.set(dst);
+  }
+  output = reg(output_);
+}
+
+CompiledCircuit CompiledCircuit::optimized() const {
+  // Deferred work per register: rescale to target and/or relinearize. state[r] describes the value actually held.
+  struct Pending {
+    bool relinearize = false;
+    bool rescale = false;
+    double target = 0;
+  };
+  std::vector<Pending> pending(register_count_);
+  // Every other register is written before it is read, and its state with it
+  std::vector<CircuitOp> state(register_count_, CircuitOp{CircuitOp::Kind::add, 0, 0});
+  for (std::size_t r = 0; r < input_count_; r++) {
+    state[r].dst = state[r].lhs = r;
+    state[r].level = input_level_;
+    state[r].scale = input_scale_;
+  }
+
+  CompiledCircuit result(*this);
+  auto &out = result.ops_;
+  out.clear();
+
+  auto flush_rescale = [&](std::size_t r) {
+    if (!pending[r].rescale) {
+      return;
+    }
+    CircuitOp op = state[r];
+    op.kind = CircuitOp::Kind::rescale;
+    op.dst = op.lhs = r;
+    op.level = state[r].level - 1;
+    op.scale = pending[r].target;
+    out.push_back(op);
+    state[r] = op;
+    pending[r].rescale = false;
+  };
+  auto flush = [&](std::size_t r) {
+    flush_rescale(r);
+    if (!pending[r].relinearize) {
+      return;
+    }
+    CircuitOp op = state[r];
+    op.kind = CircuitOp::Kind::relinearize;
+    op.dst = op.lhs = r;
+    op.size = 2;
+    out.push_back(op);
+    state[r] = op;
+    pending[r].relinearize = false;
+  };
+  auto emit = [&](CircuitOp const &op, Pending p) {
+    out.push_back(op);
+    state[op.dst] = op;
+    pending[op.dst] = p;
+  };
+
+  for (auto const &op : ops_) {
+    Pending pa = pending[op.lhs];
+    switch (op.kind) {
+      case CircuitOp::Kind::relinearize:
+      case CircuitOp::Kind::rescale:
+        if (op.dst == op.lhs) {
+          if (op.kind == CircuitOp::Kind::rescale) {
+            flush_rescale(op.lhs);
+            pending[op.lhs].rescale = true;
+            pending[op.lhs].target = op.scale;
+          } else {
+            pending[op.lhs].relinearize = true;
+          }
+        } else {
+          flush(op.lhs);
+          emit(op, {});
+        }
+        break;
+      case CircuitOp::Kind::add:
+      case CircuitOp::Kind::sub: {
+        Pending pb = pending[op.rhs];
+        CircuitOp e = op;
+        Pending p;
+        p.relinearize = pa.relinearize || pb.relinearize;
+        if (pa.rescale && pb.rescale && state[op.lhs].level == state[op.rhs].level
+            && same_scale(state[op.lhs].scale, state[op.rhs].scale) && same_scale(pa.target, pb.target)) {
+          // Add before rescaling: both products are rescaled together
+          e.level = state[op.lhs].level;
+          e.scale = state[op.lhs].scale;
+          p.rescale = true;
+          p.target = op.scale;
+        } else {
+          flush_rescale(op.lhs);
+          flush_rescale(op.rhs);
+        }
+        e.size = std::max(state[op.lhs].size, state[op.rhs].size);
+        emit(e, p);
+        break;
+      }
+      case CircuitOp::Kind::negate: {
+        CircuitOp e = op;
+        e.level = state[op.lhs].level;
+        e.scale = state[op.lhs].scale;
+        e.size = state[op.lhs].size;
+        emit(e, pa);
+        break;
+      }
+      case CircuitOp::Kind::add_plain:
+      case CircuitOp::Kind::multiply_plain:
+      case CircuitOp::Kind::mod_switch:
+      case CircuitOp::Kind::set_scale: {
+        // The plaintext is encoded for (and the switch targets) the rescaled level, but size 3 is fine
+        flush_rescale(op.lhs);
+        CircuitOp e = op;
+        e.size = state[op.lhs].size;
+        Pending p;
+        p.relinearize = pa.relinearize;
+        emit(e, p);
+        break;
+      }
+      case CircuitOp::Kind::multiply:
+      case CircuitOp::Kind::square:flush(op.lhs);
+        flush(op.rhs);
+        emit(op, {});
+        break;
+    }
+  }
+  flush(output_);
+
+  // Values used by several additions can end up relinearized more often than in the eager schedule
+  std::size_t relin = count(CircuitOp::Kind::relinearize), lazy_relin = result.count(CircuitOp::Kind::relinearize);
+  if (lazy_relin > relin
+      || (lazy_relin == relin && result.count(CircuitOp::Kind::rescale) >= count(CircuitOp::Kind::rescale))) {
+    return *this;
+  }
+  return result;
+}
+
+std::size_t CompiledCircuit::count(CircuitOp::Kind kind) const {
+  return static_cast<std::size_t>(std::count_if(ops_.begin(), ops_.end(),
+                                                [kind](CircuitOp const &op) { return op.kind == kind; }));
+}
+
+void CompiledCircuit::print(std::ostream &os) const {
+  std::ios old_fmt(nullptr);
+  old_fmt.copyfmt(os);
+  for (auto const &op : ops_) {
+    os << "r" << op.dst << " = " << op_name(op.kind) << " r" << op.lhs;
+    if (op.kind == CircuitOp::Kind::add || op.kind == CircuitOp::Kind::sub || op.kind == CircuitOp::Kind::multiply) {
+      os << ", r" << op.rhs;
+    }
+    if (op.kind == CircuitOp::Kind::add_plain || op.kind == CircuitOp::Kind::multiply_plain) {
+      os << ", " << op.value << " @ " << std::fixed << std::setprecision(2) << std::log2(op.plain_scale) << " bits";
+      os.copyfmt(old_fmt);
+    }
+    if (op.kind == CircuitOp::Kind::mod_switch) {
+      os << " x" << op.levels;
+    }
+    os << std::fixed << std::setprecision(2) << "   (level " << op.level << ", scale " << std::log2(op.scale)
+       << " bits, size " << op.size << ")" << std::endl;
+    os.copyfmt(old_fmt);
+  }
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "plaintext_cache.h"
+#include "trace.h"
+
+class Circuit;
+
+/// Handle to a value in a Circuit. Build expressions with the usual arithmetic operators, e.g.
+///   Circuit circuit;
+///   auto x = circuit.input(), y = circuit.input(), z = circuit.input();
+///   auto result = ((x + y) * (z * 5)) + 10;
+class Expr {
+ public:
+  Expr() = default;
+
+ private:
+  friend class Circuit;
+  friend Expr operator+(Expr const &a, Expr const &b);
+  friend Expr operator-(Expr const &a, Expr const &b);
+  friend Expr operator*(Expr const &a, Expr const &b);
+  friend Expr operator-(Expr const &a);
+  friend Expr operator+(Expr const &a, double b);
+  friend Expr operator*(Expr const &a, double b);
+
+  Expr(Circuit *circuit, std::size_t node) : circuit_(circuit), node_(node) {}
+
+  Circuit *circuit_ = nullptr;
+  std::size_t node_ = 0;
+};
+
+Expr operator+(Expr const &a, Expr const &b);
+Expr operator-(Expr const &a, Expr const &b);
+Expr operator*(Expr const &a, Expr const &b);
+Expr operator-(Expr const &a);
+Expr operator+(Expr const &a, double b);
+Expr operator*(Expr const &a, double b);
+inline Expr operator+(double a, Expr const &b) { return b + a; }
+inline Expr operator-(Expr const &a, double b) { return a + (-b); }
+inline Expr operator-(double a, Expr const &b) { return (-b) + a; }
+inline Expr operator*(double a, Expr const &b) { return b * a; }
+
+/// One instruction of a compiled circuit. Operands and results live in numbered ciphertext registers.
+struct CircuitOp {
+  enum class Kind {
+    add,            ///< dst = lhs + rhs
+    sub,            ///< dst = lhs - rhs
+    multiply,       ///< dst = lhs * rhs (size 3 result)
+    square,         ///< dst = lhs * lhs (size 3 result)
+    negate,         ///< dst = -lhs
+    add_plain,      ///< dst = lhs + value, value encoded at plain_scale
+    multiply_plain, ///< dst = lhs * value, value encoded at plain_scale
+    relinearize,    ///< dst = relinearize(lhs)
+    rescale,        ///< dst = rescale_to_next(lhs)
+    mod_switch,     ///< dst = mod_switch_to_next(lhs), repeated levels times
+    set_scale       ///< dst = lhs with its scale overridden to scale, an approximation that leaves the value off by
+                    ///< the relative scale mismatch (only emitted for mismatches within the compile tolerance)
+  };
+
+  Kind kind;
+  std::size_t dst;
+  std::size_t lhs;
+  std::size_t rhs = 0;
+  double value = 0;       ///< constant of add_plain / multiply_plain
+  double plain_scale = 0; ///< scale the constant is encoded at
+  std::size_t levels = 0; ///< number of levels for mod_switch
+  double scale = 0;       ///< scale of dst after this instruction
+  std::size_t level = 0;  ///< chain index of dst after this instruction
+  std::size_t size = 2;   ///< number of polynomials in dst after this instruction
+};
+
+/// A circuit lowered to SEAL operations for one set of encryption parameters: every rescale, mod-switch,
+/// relinearization and plaintext encoding is already placed, so run() just replays the instructions.
+class CompiledCircuit {
+ public:
+  /// Evaluate the circuit
+  /// \param inputs One ciphertext per Circuit::input(), in order, at the first level and the compile scale
+  /// \param output Ciphertext to store result in
+  /// \param relin_keys Required if the circuit multiplies ciphertexts
+  /// \param cache If given, the constants are taken from (and added to) this cache instead of encoded on every run
+  void run(std::vector<seal::Ciphertext> const &inputs, seal::Ciphertext &output, seal::Evaluator const &evaluator,
+           seal::CKKSEncoder const &encoder, seal::RelinKeys const *relin_keys = nullptr,
+           PlaintextCache *cache = nullptr) const;
+
+  /// Levels consumed between the inputs and the output
+  std::size_t depth() const { return depth_; }
+
+  /// Number of input ciphertexts run() expects
+  std::size_t input_count() const { return input_count_; }
+
+  /// Scale the input ciphertexts must be encoded at
+  double input_scale() const { return input_scale_; }
+
+  /// Reschedule with lazy relinearization and rescaling: relinearizations and rescales are deferred until a value is
+  /// used by something other than an addition, subtraction or negation, so a sum of products is relinearized and
+  /// rescaled once instead of once per product. Relinearizations that are still needed run after the rescale, i.e.
+  /// on one prime less. Returns this circuit unchanged if the lazy schedule would not save any work.
+  CompiledCircuit optimized() const;
+
+  /// The instructions, in execution order
+  std::vector<CircuitOp> const &ops() const { return ops_; }
+
+  /// Number of instructions of the given kind
+  std::size_t count(CircuitOp::Kind kind) const;
+
+  /// Print one line per instruction
+  void print(std::ostream &os = std::cout) const;
+
+ private:
+  friend class Circuit;
+
+  std::vector<CircuitOp> ops_;
+  std::size_t register_count_ = 0;
+  std::size_t input_count_ = 0;
+  std::size_t output_ = 0;
+  std::size_t depth_ = 0;
+  double input_scale_ = 0;
+  std::size_t input_level_ = 0;
+  seal::parms_id_type input_parms_id_ = seal::parms_id_zero;
+};
+
+/// What Circuit::compile does when the two operands of an addition have different scales
+enum class ScaleMismatch {
+  error,    ///< throw std::invalid_argument (the default, so a circuit never pays for a mismatch unnoticed)
+  realign,  ///< multiply the operand with more levels by 1 at a matching scale: exact, but may cost a level
+  set_scale ///< override the scale if the mismatch is within the scale tolerance (an approximation), else realign
+};
+
+/// Arithmetic circuit over CKKS ciphertexts, compiled to a minimum-depth sequence of SEAL operations.
+/// The compiler rescales right after every product, mod-switches operands only where two levels meet, multiplies
+/// by small integer constants at scale 1 (no level needed) and encodes every other constant at the exact scale that
+/// keeps levels and scales aligned. When two operands of an addition end up with different scales, compile() throws
+/// unless told otherwise: ScaleMismatch::realign brings the shallower one to the other's scale by a multiplication
+/// with 1 at a matching scale, and ScaleMismatch::set_scale overrides scale() instead (a set_scale instruction) if
+/// the mismatch is within the given tolerance, trading a relative error of the mismatch's size for the level. With a
+/// ModulusChain, such mismatches typically stay within its scale_tolerance(), so the error stays that small.
+class Circuit {
+ public:
+  /// Add a new encrypted input; inputs are numbered in the order they are created
+  Expr input();
+
+  /// Constant value (in every slot)
+  Expr constant(double value);
+
+  /// Multiplicative depth of an expression, independent of the encryption parameters
+  std::size_t depth(Expr const &output) const;
+
+  /// Evaluate the expression on plaintext values, as a reference for the encrypted result
+  /// \param inputs inputs[j][i] is input j of row i; one column per input, all of the same length
+  /// \return The value of the expression for every row
+  std::vector<double> evaluate(Expr const &output, std::vector<std::vector<double>> const &inputs) const;
+
+  /// Lower the expression to SEAL operations
+  /// \param output The expression to compute
+  /// \param context The encryption parameters the circuit will run with
+  /// \param scale Scale of the (fresh, first-level) input ciphertexts
+  /// \param mismatch How to add operands whose scales differ
+  /// \param scale_tolerance With ScaleMismatch::set_scale, the largest relative scale mismatch that additions may
+  /// absorb by setting the scale instead of spending a level on it (this adds a relative error of the same size);
+  /// see ModulusChain::scale_tolerance()
+  /// \throws std::invalid_argument if output is a constant, the modulus chain is too short, or two operands of an
+  /// addition have different scales and mismatch is ScaleMismatch::error
+  CompiledCircuit compile(Expr const &output, seal::SEALContext const &context, double scale,
+                          ScaleMismatch mismatch = ScaleMismatch::error, double scale_tolerance = 0) const;
+
+ private:
+  friend Expr operator+(Expr const &a, Expr const &b);
+  friend Expr operator-(Expr const &a, Expr const &b);
+  friend Expr operator*(Expr const &a, Expr const &b);
+  friend Expr operator-(Expr const &a);
+  friend Expr operator+(Expr const &a, double b);
+  friend Expr operator*(Expr const &a, double b);
+
+  struct Node {
+    enum class Kind { input, constant, add, sub, multiply, negate, add_const, multiply_const };
+    Kind kind;
+    std::size_t lhs = 0;
+    std::size_t rhs = 0;
+    double value = 0;
+  };
+
+  Expr add_node(Node node);
+  bool is_constant(Expr const &e) const { return nodes_[e.node_].kind == Node::Kind::constant; }
+  double constant_value(Expr const &e) const { return nodes_[e.node_].value; }
+
+  std::vector<Node> nodes_;
+  std::size_t input_count_ = 0;
+};
@@ -0,0 +1,170 @@
+#include "context_factory.h"
+
+#include <cstdio>
+#include <map>
+
+using namespace seal;
+
+std::shared_ptr<SharedContext> SharedContext::get(EncryptionParameters const &parms, std::string const &key_dir) {
+  static std::mutex mutex;
+  static std::map<std::pair<parms_id_type, std::string>, std::shared_ptr<SharedContext>> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &instance = instances[std::make_pair(parms.parms_id(), key_dir)];
+  if (!instance) {
+    instance = std::shared_ptr<SharedContext>(new SharedContext(parms, key_dir));
+  }
+  return instance;
+}
+
+SharedContext::SharedContext(EncryptionParameters const &parms, std::string key_dir)
+    : context_(parms), key_dir_(std::move(key_dir)) {
+  if (!context_.parameters_set()) {
+    throw std::invalid_argument(std::string("invalid encryption parameters: ") + context_.parameter_error_message());
+  }
+}
+
+std::string SharedContext::key_file(char const *suffix) const {
+  // Files are named after the parameters, so one directory can hold keys for several parameter sets
+  std::ostringstream name;
+  name << key_dir_ << "/";
+  for (auto word : context_.key_parms_id()) {
+    name << std::hex << std::setw(16) << std::setfill('0') << word;
+  }
+  name << "." << suffix;
+  return name.str();
+}
+
+template<class Key>
+bool SharedContext::load_key(char const *suffix, Key &key) const {
+  std::ifstream in(key_file(suffix), std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  try {
+    key.load(context_, in);
+  } catch (std::exception const &) {
+    return false; // truncated, corrupt, or saved for other parameters
+  }
+  return true;
+}
+
+template<class Key>
+void SharedContext::save_key(char const *suffix, Key const &key) const {
+  std::string path = key_file(suffix);
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    try {
+      key.save(out);
+    } catch (std::exception const &) {
+      out.setstate(std::ios::failbit); // SEAL throws on I/O errors; report them like any other write failure
+    }
+    out.close();
+    if (!out) {
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("cannot write key file " + tmp_path);
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("cannot replace key file " + path);
+  }
+}
+
+template<class Key, class Generate>
+std::unique_ptr<Key> SharedContext::load_or_create(char const *suffix, Generate generate) {
+  auto key = std::make_unique<Key>();
+  if (!key_dir_.empty() && secret_key_loaded_ && load_key(suffix, *key)) {
+    return key;
+  }
+  generate(*key);
+  if (!key_dir_.empty()) {
+    save_key(suffix, *key);
+  }
+  return key;
+}
+
+KeyGenerator &SharedContext::keygen() {
+  if (!keygen_) {
+    SecretKey secret_key;
+    if (!key_dir_.empty() && load_key("secret_key", secret_key)) {
+      keygen_ = std::make_unique<KeyGenerator>(context_, secret_key);
+      secret_key_loaded_ = true;
+      return *keygen_;
+    }
+    // A new secret key invalidates any other key files, which are overwritten when they are generated
+    keygen_ = std::make_unique<KeyGenerator>(context_);
+    if (!key_dir_.empty()) {
+      save_key("secret_key", keygen_->secret_key());
+    }
+  }
+  return *keygen_;
+}
+
+SecretKey const &SharedContext::secret_key() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return keygen().secret_key();
+}
+
+PublicKey const &SharedContext::public_key() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!public_key_) {
+    auto &generator = keygen();
+    public_key_ = load_or_create<PublicKey>("public_key", [&](PublicKey &key) { generator.create_public_key(key); });
+  }
+  return *public_key_;
+}
+
+RelinKeys const &SharedContext::relin_keys() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!relin_keys_) {
+    auto &generator = keygen();
+    relin_keys_ = load_or_create<RelinKeys>("relin_keys", [&](RelinKeys &key) { generator.create_relin_keys(key); });
+  }
+  return *relin_keys_;
+}
+
+GaloisKeys const &SharedContext::galois_keys() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!galois_keys_) {
+    auto &generator = keygen();
+    galois_keys_ =
+        load_or_create<GaloisKeys>("galois_keys", [&](GaloisKeys &key) { generator.create_galois_keys(key); });
+  }
+  return *galois_keys_;
+}
+
+Encryptor const &SharedContext::encryptor() {
+  auto &key = public_key();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!encryptor_) {
+    encryptor_ = std::make_unique<Encryptor>(context_, key);
+  }
+  return *encryptor_;
+}
+
+Decryptor &SharedContext::decryptor() {
+  auto &key = secret_key();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!decryptor_) {
+    decryptor_ = std::make_unique<Decryptor>(context_, key);
+  }
+  return *decryptor_;
+}
+
+Evaluator const &SharedContext::evaluator() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!evaluator_) {
+    evaluator_ = std::make_unique<Evaluator>(context_);
+  }
+  return *evaluator_;
+}
+
+CKKSEncoder const &SharedContext::encoder() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!encoder_) {
+    encoder_ = std::make_unique<CKKSEncoder>(context_);
+  }
+  return *encoder_;
+}
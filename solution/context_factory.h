@@ -0,0 +1,73 @@
+#pragma once
+
+#include "utils.h"
+
+/// One SEALContext per distinct set of encryption parameters, together with its keys and helper objects.
+/// Everything except the context is created on first use, so a caller that never relinearizes never pays for
+/// relinearization keys. With a key directory, keys are loaded from there if present and saved there after
+/// generation, so a restarted process skips key generation. Unreadable key files are regenerated; a directory
+/// that cannot be written throws std::runtime_error. The directory then holds the secret key in the clear; only
+/// use it for test and lab setups.
+///
+///   auto shared = SharedContext::get(parms);
+///   shared->encryptor().encrypt(plain, ctxt);
+///   shared->evaluator().relinearize_inplace(ctxt, shared->relin_keys());
+///
+/// All accessors are thread-safe and return references that stay valid as long as the SharedContext.
+class SharedContext {
+ public:
+  /// The shared instance for these parameters; equal parameters (same parms_id) and key directory give the same
+  /// instance, which lives until the end of the process
+  /// \param key_dir Directory to load keys from and save keys to; empty to keep keys in memory only
+  static std::shared_ptr<SharedContext> get(seal::EncryptionParameters const &parms, std::string const &key_dir = "");
+
+  SharedContext(SharedContext const &) = delete;
+  SharedContext &operator=(SharedContext const &) = delete;
+
+  seal::SEALContext const &context() const { return context_; }
+
+  seal::SecretKey const &secret_key();
+  seal::PublicKey const &public_key();
+  seal::RelinKeys const &relin_keys();
+
+  /// Galois keys for all power-of-two rotations and conjugation
+  seal::GaloisKeys const &galois_keys();
+
+  seal::Encryptor const &encryptor();
+  seal::Decryptor &decryptor();
+  seal::Evaluator const &evaluator();
+  seal::CKKSEncoder const &encoder();
+
+ private:
+  SharedContext(seal::EncryptionParameters const &parms, std::string key_dir);
+
+  seal::KeyGenerator &keygen(); // requires mutex_ to be held
+
+  std::string key_file(char const *suffix) const;
+
+  // Load key from its file if the key directory has a readable one that belongs to the current secret key,
+  // otherwise generate it and save it
+  template<class Key, class Generate>
+  std::unique_ptr<Key> load_or_create(char const *suffix, Generate generate);
+
+  // Load key from its file; false if there is none or it cannot be parsed
+  template<class Key>
+  bool load_key(char const *suffix, Key &key) const;
+
+  // Write key to a temporary file and rename it into place, so a crash never leaves a truncated key file
+  template<class Key>
+  void save_key(char const *suffix, Key const &key) const;
+
+  seal::SEALContext context_;
+  std::string key_dir_;
+  std::mutex mutex_;
+  bool secret_key_loaded_ = false;
+  std::unique_ptr<seal::KeyGenerator> keygen_;
+  std::unique_ptr<seal::PublicKey> public_key_;
+  std::unique_ptr<seal::RelinKeys> relin_keys_;
+  std::unique_ptr<seal::GaloisKeys> galois_keys_;
+  std::unique_ptr<seal::Encryptor> encryptor_;
+  std::unique_ptr<seal::Decryptor> decryptor_;
+  std::unique_ptr<seal::Evaluator> evaluator_;
+  std::unique_ptr<seal::CKKSEncoder> encoder_;
+};
@@ -0,0 +1,301 @@
+#include "utils.h"
+
+#include <cstdlib>
+#include <functional>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#define KERNELBENCH_HAVE_TSC 1
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace seal;
+
+/*
+ * Microbenchmarks for the polynomial kernels in utils.cpp, reported in cycles (and nanoseconds) per coefficient,
+ * where a polynomial with L primes has N * L coefficients.
+ *
+ *   kernelbench [--degrees 4096,...,65536] [--levels 1,2,4,8,16] [--kernels multiply,to_eval_rep]
+ *               [--threads 1,max] [--repetitions 20] [--evict-mb 256] [--csv]
+ *
+ * Every configuration runs cache-warm (the same buffers back to back) and cache-cold (all threads write an
+ * eviction buffer larger than the last-level cache before each call). Cycles are TSC ticks, which count at the
+ * nominal frequency; they are not available on non-x86 targets, where only nanoseconds are reported.
+ */
+
+namespace {
+
+struct Buffers {
+  vector<uint64_t> a, b, result;
+};
+
+/// One kernel call on polynomials of N coefficients and L primes, described by context_data
+struct Kernel {
+  char const *name;
+  bool nonzero_input; // inverse needs every value to be invertible; the others take anything in [0, q)
+  function<void(Buffers &, SEALContext::ContextData const &)> run;
+};
+
+vector<Kernel> const &kernels() {
+  static vector<Kernel> const all = {
+    {"inverse", true, [](Buffers &p, SEALContext::ContextData const &c) {
+       inverse(p.a.data(), c.parms().poly_modulus_degree(), c.parms().coeff_modulus(), p.result.data());
+     }},
+    {"multiply", false, [](Buffers &p, SEALContext::ContextData const &c) {
+       multiply(p.a.data(), p.b.data(), c.parms().poly_modulus_degree(), c.parms().coeff_modulus(), p.result.data());
+     }},
+    {"add", false, [](Buffers &p, SEALContext::ContextData const &c) {
+       add(p.a.data(), p.b.data(), c.parms().poly_modulus_degree(), c.parms().coeff_modulus(), p.result.data());
+     }},
+    {"sub", false, [](Buffers &p, SEALContext::ContextData const &c) {
+       sub(p.a.data(), p.b.data(), c.parms().poly_modulus_degree(), c.parms().coeff_modulus(), p.result.data());
+     }},
+    {"copy", false, [](Buffers &p, SEALContext::ContextData const &c) {
+       copy(p.a.data(), c.parms().poly_modulus_degree(), c.parms().coeff_modulus().size(), p.result.data());
+     }},
+    // The transforms work in place; their outputs are reduced to [0, q), so repeating them stays valid
+    {"to_eval_rep", false, [](Buffers &p, SEALContext::ContextData const &c) {
+       to_eval_rep(p.a.data(), c.parms().poly_modulus_degree(), c.parms().coeff_modulus().size(),
+                   c.small_ntt_tables());
+     }},
+    {"to_coeff_rep", false, [](Buffers &p, SEALContext::ContextData const &c) {
+       to_coeff_rep(p.a.data(), c.parms().poly_modulus_degree(), c.parms().coeff_modulus().size(),
+                    c.small_ntt_tables());
+     }},
+    {"infty_norm", false, [](Buffers &p, SEALContext::ContextData const &c) { infty_norm(p.a.data(), &c); }},
+    {"l2_norm", false, [](Buffers &p, SEALContext::ContextData const &c) { l2_norm(p.a.data(), &c); }},
+  };
+  return all;
+}
+
+uint64_t cycles() {
+#ifdef KERNELBENCH_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+int max_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void set_threads(int threads) {
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#else
+  (void)threads;
+#endif
+}
+
+/// Write every cache line of the eviction buffer from every thread, so no thread's caches hold the operands
+void evict(vector<uint64_t> &buffer) {
+  size_t const stride = 64 / sizeof(uint64_t);
+  size_t lines = buffer.size() / stride;
+#pragma omp parallel for
+  for (size_t i = 0; i < lines; i++) {
+    buffer[i * stride]++;
+  }
+}
+
+/// Fill the polynomial with uniform values mod each q_i (nonzero if nonzero is set)
+void randomPolynomial(vector<uint64_t> &poly, vector<Modulus> const &coeff_modulus, size_t coeff_count,
+                      bool nonzero, mt19937_64 &rng) {
+  poly.resize(coeff_count * coeff_modulus.size());
+  for (size_t j = 0; j < coeff_modulus.size(); j++) {
+    uint64_t q = coeff_modulus[j].value();
+    for (size_t i = 0; i < coeff_count; i++) {
+      poly[j * coeff_count + i] = nonzero ? 1 + rng() % (q - 1) : rng() % q;
+    }
+  }
+}
+
+struct Measurement {
+  double cycles_per_coeff; // median over the repetitions
+  double ns_per_coeff;
+};
+
+Measurement measure(Kernel const &kernel, Buffers &buffers, SEALContext::ContextData const &context_data,
+                    size_t repetitions, vector<uint64_t> *eviction) {
+  double coeffs = static_cast<double>(buffers.a.size());
+  vector<double> cycle_samples, ns_samples;
+  kernel.run(buffers, context_data); // warm-up: page faults, lazily built tables, OpenMP thread start
+  for (size_t r = 0; r < repetitions; r++) {
+    if (eviction) {
+      evict(*eviction);
+    }
+    auto start = chrono::steady_clock::now();
+    uint64_t start_cycles = cycles();
+    kernel.run(buffers, context_data);
+    uint64_t end_cycles = cycles();
+    auto end = chrono::steady_clock::now();
+    cycle_samples.push_back(static_cast<double>(end_cycles - start_cycles) / coeffs);
+    ns_samples.push_back(chrono::duration<double, nano>(end - start).count() / coeffs);
+  }
+  auto median = [](vector<double> &v) {
+    sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+  };
+  return {median(cycle_samples), median(ns_samples)};
+}
+
+vector<string> split(string const &list) {
+  vector<string> items;
+  stringstream ss(list);
+  string item;
+  while (getline(ss, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+vector<size_t> parseSizes(string const &list) {
+  vector<size_t> sizes;
+  for (auto const &item : split(list)) {
+    sizes.push_back(stoul(item));
+  }
+  return sizes;
+}
+
+void printUsage(ostream &os) {
+  os << "Usage: kernelbench [--degrees LIST] [--levels LIST] [--kernels LIST] [--threads LIST|max]\n"
+        "                   [--repetitions N] [--evict-mb MB] [--csv]\n"
+        "Defaults: --degrees 4096,8192,16384,32768,65536 --levels 1,2,4,8,16 --threads 1,max --repetitions 20\n"
+        "          --evict-mb 256; all kernels:";
+  for (auto const &kernel : kernels()) {
+    os << " " << kernel.name;
+  }
+  os << endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  vector<size_t> degrees = {4096, 8192, 16384, 32768, 65536};
+  vector<size_t> levels = {1, 2, 4, 8, 16};
+  vector<string> selected;
+  vector<int> thread_counts = {1, max_threads()};
+  size_t repetitions = 20;
+  size_t evict_mb = 256;
+  bool csv = false;
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      string arg = argv[i];
+      if (arg == "--csv") {
+        csv = true;
+        continue;
+      }
+      if (arg == "--help" || i + 1 == argc) {
+        printUsage(arg == "--help" ? cout : cerr);
+        return arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+      string value = argv[++i];
+      if (arg == "--degrees") {
+        degrees = parseSizes(value);
+      } else if (arg == "--levels") {
+        levels = parseSizes(value);
+      } else if (arg == "--kernels") {
+        selected = split(value);
+      } else if (arg == "--threads") {
+        thread_counts.clear();
+        for (auto const &item : split(value)) {
+          thread_counts.push_back(item == "max" ? max_threads() : stoi(item));
+        }
+      } else if (arg == "--repetitions") {
+        repetitions = stoul(value);
+      } else if (arg == "--evict-mb") {
+        evict_mb = stoul(value);
+      } else {
+        throw invalid_argument("unknown option " + arg);
+      }
+    }
+    for (auto const &name : selected) {
+      if (none_of(kernels().begin(), kernels().end(), [&](Kernel const &k) { return name == k.name; })) {
+        throw invalid_argument("unknown kernel " + name);
+      }
+    }
+    if (repetitions == 0 || any_of(thread_counts.begin(), thread_counts.end(), [](int t) { return t < 1; })) {
+      throw invalid_argument("repetitions and thread counts must be positive");
+    }
+  } catch (exception const &e) {
+    cerr << "kernelbench: " << e.what() << endl;
+    printUsage(cerr);
+    return EXIT_FAILURE;
+  }
+  // "1,max" on a single-core machine (or without OpenMP) is one configuration
+  sort(thread_counts.begin(), thread_counts.end());
+  thread_counts.erase(unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+  vector<uint64_t> eviction(evict_mb * (size_t(1) << 20) / sizeof(uint64_t));
+  mt19937_64 rng(default_random_seed);
+
+  if (csv) {
+    cout << "kernel,N,L,threads,cache,cycles_per_coeff,ns_per_coeff" << endl;
+  } else {
+    cout << left << setw(14) << "kernel" << right << setw(7) << "N" << setw(4) << "L" << setw(9) << "threads"
+         << setw(7) << "cache" << setw(14) << "cycles/coeff" << setw(12) << "ns/coeff" << endl;
+  }
+  cout << fixed << setprecision(3);
+
+  for (size_t degree : degrees) {
+    for (size_t level_count : levels) {
+      // All L primes at one level; small N with many primes is below any security level, which is fine here
+      EncryptionParameters parms(scheme_type::ckks);
+      string error;
+      try {
+        parms.set_poly_modulus_degree(degree);
+        parms.set_coeff_modulus(CoeffModulus::Create(degree, vector<int>(level_count, 50)));
+      } catch (exception const &e) {
+        error = e.what();
+      }
+      SEALContext context(parms, false, sec_level_type::none);
+      if (error.empty() && !context.parameters_set()) {
+        error = context.parameter_error_message();
+      }
+      if (!error.empty()) {
+        cerr << "kernelbench: skipping N = " << degree << ", L = " << level_count << ": " << error << endl;
+        continue;
+      }
+      auto const &context_data = *context.key_context_data();
+      auto const &coeff_modulus = context_data.parms().coeff_modulus();
+
+      for (auto const &kernel : kernels()) {
+        if (!selected.empty() && find(selected.begin(), selected.end(), kernel.name) == selected.end()) {
+          continue;
+        }
+        Buffers buffers;
+        randomPolynomial(buffers.a, coeff_modulus, degree, kernel.nonzero_input, rng);
+        randomPolynomial(buffers.b, coeff_modulus, degree, kernel.nonzero_input, rng);
+        buffers.result.resize(buffers.a.size());
+
+        for (int threads : thread_counts) {
+          set_threads(threads);
+          for (bool cold : {false, true}) {
+            auto m = measure(kernel, buffers, context_data, repetitions, cold ? &eviction : nullptr);
+            if (csv) {
+              cout << kernel.name << "," << degree << "," << level_count << "," << threads << ","
+                   << (cold ? "cold" : "warm") << "," << m.cycles_per_coeff << "," << m.ns_per_coeff << endl;
+            } else {
+              cout << left << setw(14) << kernel.name << right << setw(7) << degree << setw(4) << level_count
+                   << setw(9) << threads << setw(7) << (cold ? "cold" : "warm") << setw(14) << m.cycles_per_coeff
+                   << setw(12) << m.ns_per_coeff << endl;
+            }
+          }
+        }
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
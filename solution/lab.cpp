@@ -1,4 +1,14 @@
 #include "utils.h"
+#include "batch.h"
+#include "pipeline.h"
+#include "context_factory.h"
+#include "tuner.h"
+#include "trace.h"
+#include "bulk_crypto.h"
+#include "modulus_chain.h"
+#include "plain_operand.h"
+#include "shadow_evaluator.h"
+#include "poly_eval.h"
 
 using namespace std;
 using namespace seal;
@@ -7,37 +17,356 @@ void ckks_module1();
 void ckks_module2();
 void ckks_module3a();
 void ckks_module3b();
+void ckks_module4();
+
+/*
+ * Every CKKS module uses N = 16384 and {30, 30, 30, 30, 30}. The context and keys are set up once per process;
+ * with LAB_KEY_DIR set, keys are also kept in that directory, so later runs skip key generation.
+ */
+shared_ptr<SharedContext> lab_context() {
+  EncryptionParameters parms(scheme_type::ckks);
+
+  size_t poly_modulus_degree = 16384;
+  parms.set_poly_modulus_degree(poly_modulus_degree);
+  parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, {30, 30, 30, 30, 30}));
+
+  char const *key_dir = getenv("LAB_KEY_DIR");
+  return SharedContext::get(parms, key_dir ? key_dir : "");
+}
+
+/*
+ * Philox4x32-10 against the known-answer vectors of the Random123 reference implementation (kat_vectors), so a
+ * change to the generator cannot silently change every random input of the lab.
+ */
+bool check_philox() {
+  struct KnownAnswer {
+    uint32_t counter[4];
+    uint32_t key[2];
+    uint32_t expected[4];
+  };
+  KnownAnswer const vectors[] = {
+      {{0x00000000, 0x00000000, 0x00000000, 0x00000000}, {0x00000000, 0x00000000},
+       {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+      {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff},
+       {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+      {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0},
+       {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+  };
+  auto words = [](uint32_t lo, uint32_t hi) { return (uint64_t(hi) << 32) | lo; };
+  for (auto const &v : vectors) {
+    // The seed is the key, the stream counter words 2-3 and the block counter words 0-1
+    Philox4x32 gen(words(v.key[0], v.key[1]), words(v.counter[2], v.counter[3]));
+    uint64_t out0, out1;
+    gen.block(words(v.counter[0], v.counter[1]), out0, out1);
+    if (out0 != words(v.expected[0], v.expected[1]) || out1 != words(v.expected[2], v.expected[3])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The soa_cx_vector evalPlain* overloads against the std::vector<cx_double> ones they replace in ShadowEvaluator, to
+ * within rounding (std::complex division scales differently), and each of them once more with res aliasing an input,
+ * which must give bit-identical results.
+ */
+bool check_soa() {
+  size_t const n = 1000; // not a multiple of any vector width, so the remainder loops run too
+  vector<double> parts(4 * n);
+  randomUniform(parts.data(), parts.size(), default_random_seed);
+  vector<cx_double> x(n), y(n);
+  for (size_t i = 0; i < n; i++) {
+    x[i] = cx_double(2 * parts[i] - 1, 2 * parts[n + i] - 1);
+    y[i] = cx_double(2 * parts[2 * n + i] - 1, 2 * parts[3 * n + i] - 1);
+  }
+  soa_cx_vector soa_x, soa_y;
+  toSoaVector(soa_x, x);
+  toSoaVector(soa_y, y);
+
+  auto matches = [](vector<cx_double> const &aos, soa_cx_vector const &soa, soa_cx_vector const &aliased) {
+    vector<cx_double> converted;
+    toComplexVector(converted, soa);
+    return converted.size() == aos.size() && maxDiff(converted, aos) <= 1e-12 * largestElm(aos)
+        && aliased.re == soa.re && aliased.im == soa.im;
+  };
+  vector<cx_double> aos;
+  soa_cx_vector soa, aliased;
+
+  evalPlainAdd(aos, x, y);
+  evalPlainAdd(soa, soa_x, soa_y);
+  aliased = soa_x;
+  evalPlainAdd(aliased, aliased, soa_y);
+  if (!matches(aos, soa, aliased)) {
+    return false;
+  }
+
+  evalPlainMul(aos, x, y);
+  evalPlainMul(soa, soa_x, soa_y);
+  aliased = soa_x;
+  evalPlainMul(aliased, aliased, soa_y);
+  if (!matches(aos, soa, aliased)) {
+    return false;
+  }
+  evalPlainMul(aos, x, x);
+  evalPlainMul(soa, soa_x, soa_x);
+  aliased = soa_x;
+  evalPlainMul(aliased, aliased, aliased);
+  if (!matches(aos, soa, aliased)) {
+    return false;
+  }
+
+  evalPlainNegate(aos, x);
+  evalPlainNegate(soa, soa_x);
+  aliased = soa_x;
+  evalPlainNegate(aliased, aliased);
+  if (!matches(aos, soa, aliased)) {
+    return false;
+  }
+
+  evalPlainInverse(aos, x);
+  evalPlainInverse(soa, soa_x);
+  aliased = soa_x;
+  evalPlainInverse(aliased, aliased);
+  if (!matches(aos, soa, aliased)) {
+    return false;
+  }
+
+  evalPlainPowerOf2(aos, x, 3);
+  evalPlainPowerOf2(soa, soa_x, 3);
+  aliased = soa_x;
+  evalPlainPowerOf2(aliased, aliased, 3);
+  return matches(aos, soa, aliased);
+}
+
+/*
+ * RandomDataset as module 4's pipeline producer uses it: every chunk but the last holds slot_count values, the last
+ * one the remainder, and the chunks put together are the dataset generated in one piece. The same seed gives the
+ * same data again, from a new dataset, after reset() or chunk by chunk in any order; another seed does not.
+ */
+bool check_random_dataset(size_t slot_count) {
+  uint64_t total = 3 * slot_count + 17;
+  RandomDataset whole(total, total, 2.0, sample_type::real, default_random_seed, 5);
+  vector<cx_double> expected;
+  whole.next(expected);
+
+  RandomDataset dataset(total, slot_count, 2.0, sample_type::real, default_random_seed, 5);
+  if (dataset.chunk_count() != 4) {
+    return false;
+  }
+  vector<cx_double> joined, chunk;
+  while (dataset.next(chunk)) {
+    bool last = joined.size() + chunk.size() == total;
+    if (chunk.size() != (last ? 17 : slot_count)) {
+      return false;
+    }
+    joined.insert(joined.end(), chunk.begin(), chunk.end());
+  }
+  for (auto const &v : joined) {
+    if (v.imag() != 0 || fabs(v.real()) > 2) {
+      return false;
+    }
+  }
+  if (joined != expected) {
+    return false;
+  }
+
+  RandomDataset again(total, slot_count, 2.0, sample_type::real, default_random_seed, 5);
+  dataset.reset();
+  vector<cx_double> first, first_again, last(slot_count);
+  dataset.next(first);
+  again.next(first_again);
+  if (first != first_again || first != vector<cx_double>(joined.begin(), joined.begin() + slot_count)) {
+    return false;
+  }
+  if (again.chunk(3, last.data()) != 17 || !equal(last.begin(), last.begin() + 17, joined.end() - 17)) {
+    return false;
+  }
+  RandomDataset other(total, slot_count, 2.0, sample_type::real, default_random_seed + 1, 5);
+  other.next(chunk);
+  return chunk != first;
+}
+
+/*
+ * Uniform random polynomial of the given level, reduced modulo each of its primes
+ */
+vector<uint64_t> random_polynomial(SEALContext::ContextData const &data, uint64_t stream) {
+  auto const &coeff_modulus = data.parms().coeff_modulus();
+  size_t coeff_count = data.parms().poly_modulus_degree();
+  vector<uint64_t> poly(coeff_count * coeff_modulus.size());
+  Philox4x32 gen(default_random_seed, stream);
+  for (size_t i = 0; i < poly.size(); i++) {
+    uint64_t r0, r1;
+    gen.block(i, r0, r1);
+    poly[i] = r0 % coeff_modulus[i / coeff_count].value();
+  }
+  return poly;
+}
+
+/*
+ * crt_decompose(crt_compose(a)) == a for a random polynomial at every level of the chain. The lab's key level has
+ * 150 bits and the levels below at most 120, so this covers both the multiprecision and the 128-bit path.
+ */
+bool check_crt(SEALContext const &context) {
+  for (auto data = context.key_context_data(); data; data = data->next_context_data()) {
+    vector<uint64_t> poly = random_polynomial(*data, data->chain_index());
+    vector<uint64_t> composed(poly.size()), decomposed(poly.size());
+    crt_compose(poly.data(), data.get(), composed.data());
+    crt_decompose(composed.data(), data.get(), decomposed.data());
+    if (decomposed != poly) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * PolynomialEvaluator on a dense degree-7 polynomial (two giant steps) and on pi*x^3 + 0.4*x + 1, against
+ * evalPlainPolynomial on the same inputs. The lab chain is too short and its scale too close to the primes for
+ * degree 7, so this uses its own 40-bit chain. Fails if a result is not at chain_index - plan.depth or has less
+ * than 20 bits of precision.
+ */
+bool check_polynomials() {
+  EncryptionParameters parms(scheme_type::ckks);
+  parms.set_poly_modulus_degree(16384);
+  parms.set_coeff_modulus(CoeffModulus::Create(16384, {60, 40, 40, 40, 40, 60}));
+  auto shared = SharedContext::get(parms);
+  SEALContext const &context = shared->context();
+  TracedEncryptor encryptor(shared->encryptor());
+  TracedDecryptor decryptor(shared->decryptor());
+  TracedEncoder encoder(shared->encoder());
+  double scale = pow(2.0, 40);
+
+  size_t slot_count = encoder.slot_count();
+  vector<double> values(slot_count);
+  randomUniform(values.data(), slot_count, default_random_seed);
+  for (auto &v : values) {
+    v = 2 * v - 1;
+  }
+  soa_cx_vector soa_values;
+  toSoaVector(soa_values, values);
+  Plaintext plain_x;
+  encoder.encode(values, scale, plain_x);
+  Ciphertext ctxt_x;
+  encryptor.encrypt(plain_x, ctxt_x);
+  size_t chain_index = context.get_context_data(ctxt_x.parms_id())->chain_index();
+
+  PolynomialEvaluator polynomials(context, shared->evaluator(), encoder, shared->relin_keys());
+  vector<vector<double>> tests = {{0.5, -1, 0.25, 1, -0.5, 0.125, 1, -0.25}, {1, 0.4, 0, M_PI}};
+  for (auto const &coeffs : tests) {
+    auto plan = PolyEvalPlan::Create(coeffs);
+    Ciphertext ctxt_result;
+    polynomials.evaluate(ctxt_x, coeffs, ctxt_result);
+    size_t result_index = context.get_context_data(ctxt_result.parms_id())->chain_index();
+
+    Plaintext plain_result;
+    vector<cx_double> decoded, expected;
+    decryptor.decrypt(ctxt_result, plain_result);
+    encoder.decode(plain_result, decoded);
+    soa_cx_vector soa_expected;
+    evalPlainPolynomial(soa_expected, soa_values, coeffs);
+    toComplexVector(expected, soa_expected);
+    PrecisionReport report;
+    report.add(decoded, expected);
+    cout << "Polynomial of degree " << plan.degree << " (" << plan.giant_steps << " giant steps, depth " << plan.depth
+         << "): ";
+    report.print();
+    if (result_index + plan.depth != chain_index || report.quantile(1) < 20) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * apply_galois against SEAL's GaloisTool for rotations by several steps and conjugation, in coefficient and in NTT
+ * form, and apply_galois_many against one apply_galois per element.
+ */
+bool check_galois(SEALContext const &context) {
+  auto data = context.key_context_data();
+  auto const &coeff_modulus = data->parms().coeff_modulus();
+  size_t coeff_count = data->parms().poly_modulus_degree();
+  auto const &galois_tool = *data->galois_tool();
+  vector<uint32_t> galois_elts = galois_tool.get_elts_from_steps({1, -1, 2, 7, -300, 0}); // 0: conjugation
+  vector<uint64_t> poly = random_polynomial(*data, 0);
+
+  for (bool ntt_form : {false, true}) {
+    vector<uint64_t> result(poly.size()), expected(poly.size());
+    vector<uint64_t> many(galois_elts.size() * poly.size());
+    apply_galois_many(poly.data(), coeff_count, coeff_modulus, galois_elts, ntt_form, many.data());
+    for (size_t k = 0; k < galois_elts.size(); k++) {
+      apply_galois(poly.data(), coeff_count, coeff_modulus, galois_elts[k], ntt_form, result.data());
+      for (size_t j = 0; j < coeff_modulus.size(); j++) {
+        size_t offset = j * coeff_count;
+        if (ntt_form) {
+          galois_tool.apply_galois_ntt(poly.data() + offset, galois_elts[k], expected.data() + offset);
+        } else {
+          galois_tool.apply_galois(poly.data() + offset, galois_elts[k], coeff_modulus[j], expected.data() + offset);
+        }
+      }
+      if (result != expected || !equal(result.begin(), result.end(), many.begin() + k * poly.size())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
 int main() {
+  if (!check_philox()) {
+    cerr << "Philox4x32-10 does not match the Random123 known answers" << endl;
+    return 1;
+  }
+  if (!check_soa()) {
+    cerr << "The soa_cx_vector reference evaluation does not match the std::vector<cx_double> one" << endl;
+    return 1;
+  }
+  if (!check_random_dataset(lab_context()->encoder().slot_count())) {
+    cerr << "RandomDataset does not split the dataset into reproducible slot-sized chunks" << endl;
+    return 1;
+  }
+  if (!check_crt(lab_context()->context())) {
+    cerr << "crt_decompose does not invert crt_compose" << endl;
+    return 1;
+  }
+  if (!check_galois(lab_context()->context())) {
+    cerr << "apply_galois does not match SEAL's GaloisTool" << endl;
+    return 1;
+  }
+  if (!check_polynomials()) {
+    cerr << "PolynomialEvaluator does not match evalPlainPolynomial" << endl;
+    return 1;
+  }
+
+  // LAB_TRACE=<file> records every traced operation and writes it as Chrome trace JSON
+  char const *trace_file = getenv("LAB_TRACE");
+  Tracer::enable(trace_file != nullptr);
+
   ckks_module1();
   ckks_module2();
   ckks_module3a();
   ckks_module3b();
+  ckks_module4();
+
+  if (trace_file && !Tracer::write_json(trace_file)) {
+    cerr << "Could not write trace to " << trace_file << endl;
+  }
   return 0;
 }
 
 void ckks_module1() {
   cout << "\n\n Module 1: Ciphertext-Plaintext without rescaling!" << endl;
-  EncryptionParameters parms(scheme_type::ckks);
-
-  size_t poly_modulus_degree = 16384;
-  parms.set_poly_modulus_degree(poly_modulus_degree);
-  parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, {30, 30, 30, 30, 30}));
-  double scale = pow(2.0, 30);;
+  auto shared = lab_context();
+  SEALContext const &context = shared->context();
+  double scale = pow(2.0, 30);
 
-  SEALContext context(parms);
   print_parameters(context, scale);
   cout << endl;
 
-  KeyGenerator keygen(context);
-  auto secret_key = keygen.secret_key();
-  PublicKey public_key;
-  keygen.create_public_key(public_key);
-  Encryptor encryptor(context, public_key);
-  Evaluator evaluator(context);
-  Decryptor decryptor(context, secret_key);
+  TracedEncryptor encryptor(shared->encryptor());
+  TracedEvaluator evaluator(shared->evaluator());
+  TracedDecryptor decryptor(shared->decryptor());
 
-  CKKSEncoder encoder(context);
+  TracedEncoder encoder(shared->encoder());
   size_t slot_count = encoder.slot_count();
   cout << "Number of slots: " << slot_count << endl;
 
@@ -119,6 +448,31 @@ void ckks_module1() {
   vector<double> decoded_result;
   encoder.decode(plain_result, decoded_result);
   cout << "Computed result: " << decoded_result[0] << endl;
+
+  /*
+   * Compare every slot against the exact result ((3.1 + 4.1) * (5.9 * 5)) + 10
+   */
+  PrecisionReport report;
+  report.add(decoded_result, ((3.1 + 4.1) * (5.9 * 5)) + 10);
+  report.print();
+
+  /*
+   * A PlainOperand encodes 5 once and multiplies at any level: z*5 at the top level and again after dropping
+   * z to the next level, without re-encoding or mod-switching the plaintext.
+   */
+  print_line(__LINE__);
+  cout << "Compute z*5 at two levels with one PlainOperand:" << endl;
+  PlainOperand five(context, encoder, 5.0, scale);
+  Ciphertext ctxt_z_top = ctxt_z, ctxt_z_low;
+  evaluator.mod_switch_to_next(ctxt_z, ctxt_z_low);
+  PrecisionReport operand_report;
+  for (Ciphertext *ctxt : {&ctxt_z_top, &ctxt_z_low}) {
+    five.multiply_plain_inplace(*ctxt);
+    decryptor.decrypt(*ctxt, plain_result);
+    encoder.decode(plain_result, decoded_result);
+    operand_report.add(decoded_result, 5.9 * 5);
+  }
+  operand_report.print();
 }
 
 using namespace seal;
@@ -151,10 +505,14 @@ int attack() {
   keygen.create_public_key(public_key);
   SecretKey secret_key = keygen.secret_key();
 
-  Encryptor encryptor(context, public_key);
-  Evaluator evaluator(context);
-  Decryptor decryptor(context, secret_key);
-  CKKSEncoder encoder(context);
+  Encryptor seal_encryptor(context, public_key);
+  Evaluator seal_evaluator(context);
+  Decryptor seal_decryptor(context, secret_key);
+  CKKSEncoder seal_encoder(context);
+  TracedEncryptor encryptor(seal_encryptor);
+  TracedEvaluator evaluator(seal_evaluator);
+  TracedDecryptor decryptor(seal_decryptor);
+  TracedEncoder encoder(seal_encoder);
   size_t slot_count = encoder.slot_count();  // Let's use all the available slots
 
   // Set the initial scale
@@ -260,28 +618,47 @@ void ckks_module2() {
   std::cout << "Attack worked " << success << " times out of " << iterations << std::endl;
 }
 
+/*
+ * ((x+y) * (z*5)) + 10 exactly as module 3a computes it, written once against ShadowEvaluator<Track>. With
+ * tracking, every step is mirrored on plaintext values; without, it is the bare Evaluator calls.
+ */
+template<bool Track>
+Ciphertext module3a_circuit(ShadowEvaluator<Track> &shadow, Ciphertext const &ctxt_x, Ciphertext const &ctxt_y,
+                            Ciphertext const &ctxt_z, Ciphertext const &ctxt_ten, Plaintext const &plain_five,
+                            double scale) {
+  auto x = shadow.track(ctxt_x, 3.1);
+  auto y = shadow.track(ctxt_y, 4.1);
+  auto z = shadow.track(ctxt_z, 5.9);
+  auto ten = shadow.track(ctxt_ten, 10);
+
+  typename ShadowEvaluator<Track>::ciphertext_type x_plus_y, z_times_five, t, result;
+  shadow.add(x, y, x_plus_y);
+  shadow.multiply_plain(z, plain_five, 5.0, z_times_five);
+  shadow.multiply(x_plus_y, z_times_five, t);
+  shadow.rescale_to_next_inplace(t);
+  shadow.rescale_to_next_inplace(t);
+  shadow.mod_switch_to_next_inplace(ten);
+  shadow.mod_switch_to_next_inplace(ten);
+  t.ctxt.scale() = scale; // the same override as above; the shadow keeps the exact value
+  shadow.add(t, ten, result);
+  shadow.checkpoint(result, "result");
+  return result.ctxt;
+}
+
 void ckks_module3a() {
   cout << "\n\n Module 3a: Encrypted 10" << endl;
-  EncryptionParameters parms(scheme_type::ckks);
-
-  size_t poly_modulus_degree = 16384;
-  parms.set_poly_modulus_degree(poly_modulus_degree);
-  parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, {30, 30, 30, 30, 30}));
-  double scale = pow(2.0, 30);;
+  auto shared = lab_context();
+  SEALContext const &context = shared->context();
+  double scale = pow(2.0, 30);
 
-  SEALContext context(parms);
   print_parameters(context, scale);
   cout << endl;
 
-  KeyGenerator keygen(context);
-  auto secret_key = keygen.secret_key();
-  PublicKey public_key;
-  keygen.create_public_key(public_key);
-  Encryptor encryptor(context, public_key);
-  Evaluator evaluator(context);
-  Decryptor decryptor(context, secret_key);
+  TracedEncryptor encryptor(shared->encryptor());
+  TracedEvaluator evaluator(shared->evaluator());
+  TracedDecryptor decryptor(shared->decryptor());
 
-  CKKSEncoder encoder(context);
+  TracedEncoder encoder(shared->encoder());
   size_t slot_count = encoder.slot_count();
   cout << "Number of slots: " << slot_count << endl;
 
@@ -379,7 +756,8 @@ void ckks_module3a() {
   print_line(__LINE__);
   cout << "Mod-switch ctxt_ten down:" << endl;
   evaluator.mod_switch_to_next_inplace(ctxt_ten);
-  evaluator.mod_switch_to_next_inplace(ctxt_ten); //twice, just as we had to rescale twice
+  // twice, just as we had to rescale twice
+  evaluator.mod_switch_to_next_inplace(ctxt_ten);
 
 
   /*
@@ -422,37 +800,54 @@ void ckks_module3a() {
   vector<double> decoded_result;
   encoder.decode(plain_result, decoded_result);
   cout << "Computed result: " << decoded_result[0] << endl;
+
+  /*
+   * Compare every slot against the exact result ((3.1 + 4.1) * (5.9 * 5)) + 10
+   */
+  PrecisionReport report;
+  report.add(decoded_result, ((3.1 + 4.1) * (5.9 * 5)) + 10);
+  report.print();
+
+  /*
+   * The same computation through ShadowEvaluator, which decrypts after every step and shows where the error
+   * comes from. ShadowEvaluator<false> runs the identical code without any of that.
+   */
+  print_line(__LINE__);
+  cout << "Recompute with ShadowEvaluator, checking every step:" << endl;
+  Ciphertext ctxt_ten_fresh; // ctxt_ten has been mod-switched down above
+  encryptor.encrypt(plain_ten, ctxt_ten_fresh);
+  ShadowEvaluator<> shadow(context, evaluator, encoder, &shared->decryptor());
+  shadow.set_check_every_op(true);
+  module3a_circuit(shadow, ctxt_x, ctxt_y, ctxt_z, ctxt_ten_fresh, plain_five, scale);
+  shadow.print_log();
+
+  ShadowEvaluator<false> untracked(context, evaluator, encoder);
+  Ciphertext ctxt_untracked = module3a_circuit(untracked, ctxt_x, ctxt_y, ctxt_z, ctxt_ten_fresh, plain_five, scale);
+  decryptor.decrypt(ctxt_untracked, plain_result);
+  encoder.decode(plain_result, decoded_result);
+  cout << "Untracked result: " << decoded_result[0] << endl;
 }
 
 void ckks_module3b() {
   cout << "\n\n Module 3b: Encrypted 10 and 5" << endl;
-  EncryptionParameters parms(scheme_type::ckks);
-
-  size_t poly_modulus_degree = 16384;
-  parms.set_poly_modulus_degree(poly_modulus_degree);
-  parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, {30, 30, 30, 30, 30}));
+  auto shared = lab_context();
+  SEALContext const &context = shared->context();
   double scale = pow(2.0, 30);
 
-  SEALContext context(parms);
   print_parameters(context, scale);
   cout << endl;
 
-  KeyGenerator keygen(context);
-  auto secret_key = keygen.secret_key();
-  PublicKey public_key;
-  keygen.create_public_key(public_key);
-  Encryptor encryptor(context, public_key);
-  Evaluator evaluator(context);
-  Decryptor decryptor(context, secret_key);
+  TracedEncryptor encryptor(shared->encryptor());
+  TracedEvaluator evaluator(shared->evaluator());
+  TracedDecryptor decryptor(shared->decryptor());
 
 
   /*
-   * Generate Relinearization Keys
+   * Relinearization Keys are generated on first use
    */
-  RelinKeys relin_keys;
-  keygen.create_relin_keys(relin_keys);
+  RelinKeys const &relin_keys = shared->relin_keys();
 
-  CKKSEncoder encoder(context);
+  TracedEncoder encoder(shared->encoder());
   size_t slot_count = encoder.slot_count();
   cout << "Number of slots: " << slot_count << endl;
 
@@ -539,7 +934,8 @@ void ckks_module3b() {
   print_line(__LINE__);
   cout << "Mod-switch ctxt_ten down:" << endl;
   evaluator.mod_switch_to_next_inplace(ctxt_ten);
-  evaluator.mod_switch_to_next_inplace(ctxt_ten); //twice, just as we had to rescale twice
+  // twice, just as we had to rescale twice
+  evaluator.mod_switch_to_next_inplace(ctxt_ten);
 
 
   /*
@@ -567,4 +963,240 @@ void ckks_module3b() {
   vector<double> decoded_result;
   encoder.decode(plain_result, decoded_result);
   cout << "Computed result: " << decoded_result[0] << endl;
-}
\ No newline at end of file
+
+  /*
+   * Compare every slot against the exact result ((3.1 + 4.1) * (5.9 * 5)) + 10
+   */
+  PrecisionReport report;
+  report.add(decoded_result, ((3.1 + 4.1) * (5.9 * 5)) + 10);
+  report.print();
+
+  /*
+   * The same sequence recorded through the circuit builder, with 5 and 10 as encrypted inputs as above. Instead of
+   * overriding the scale, the compiler brings 10 to the scale of the product with a multiplication by 1 and a
+   * rescale. The eager schedule rescales the product and 10 separately; the lazy one adds them first, rescales the
+   * sum once and relinearizes it after that rescale, on one prime less.
+   */
+  Circuit circuit;
+  auto x = circuit.input(), y = circuit.input(), z = circuit.input();
+  auto five = circuit.input(), ten = circuit.input();
+  auto sequence = ((x + y) * (z * five)) + ten;
+  CompiledCircuit eager = circuit.compile(sequence, context, scale, ScaleMismatch::realign);
+  CompiledCircuit lazy = eager.optimized();
+  print_line(__LINE__);
+  cout << "Recorded as a circuit: relinearizations: " << eager.count(CircuitOp::Kind::relinearize) << " eager, "
+       << lazy.count(CircuitOp::Kind::relinearize) << " lazy; rescales: " << eager.count(CircuitOp::Kind::rescale)
+       << " eager, " << lazy.count(CircuitOp::Kind::rescale) << " lazy" << endl;
+  lazy.print();
+
+  Ciphertext ctxt_ten_fresh; // ctxt_ten has been mod-switched down above
+  encryptor.encrypt(plain_ten, ctxt_ten_fresh);
+  Ciphertext ctxt_lazy;
+  lazy.run({ctxt_x, ctxt_y, ctxt_z, ctxt_five, ctxt_ten_fresh}, ctxt_lazy, evaluator, encoder, &relin_keys);
+  decryptor.decrypt(ctxt_lazy, plain_result);
+  encoder.decode(plain_result, decoded_result);
+  PrecisionReport lazy_report;
+  lazy_report.add(decoded_result, ((3.1 + 4.1) * (5.9 * 5)) + 10);
+  lazy_report.print();
+}
+
+void ckks_module4() {
+  cout << "\n\n Module 4: The same circuit, compiled" << endl;
+  auto shared = lab_context();
+  SEALContext const &context = shared->context();
+  double scale = pow(2.0, 30);
+
+  print_parameters(context, scale);
+  cout << endl;
+
+  RelinKeys const &relin_keys = shared->relin_keys();
+  TracedEncryptor encryptor(shared->encryptor());
+  TracedEvaluator evaluator(shared->evaluator());
+  TracedDecryptor decryptor(shared->decryptor());
+  TracedEncoder encoder(shared->encoder());
+
+  /*
+   * Describe ((x+y) * (z*5)) + 10 once; the compiler places every relinearization, rescale and mod-switch
+   * and picks the scales for the constants, so no scale() is ever overridden by hand.
+   */
+  Circuit circuit;
+  auto x = circuit.input(), y = circuit.input(), z = circuit.input();
+  auto result = ((x + y) * (z * 5)) + 10;
+  CompiledCircuit compiled = circuit.compile(result, context, scale).optimized();
+  print_line(__LINE__);
+  cout << "Compiled circuit (depth " << compiled.depth() << "):" << endl;
+  compiled.print();
+
+  vector<Plaintext> plains(3);
+  double values[] = {3.1, 4.1, 5.9};
+  for (size_t i = 0; i < plains.size(); i++) {
+    encoder.encode(values[i], scale, plains[i]);
+  }
+  vector<Ciphertext> inputs;
+  encrypt_many(encryptor, plains, inputs);
+
+  Ciphertext ctxt_result;
+  compiled.run(inputs, ctxt_result, evaluator, encoder, &relin_keys);
+  cout << "Scale of ((x+y) * (z*5)) + 10: " << log2(ctxt_result.scale()) << " bits" << endl;
+
+  Plaintext plain_result;
+  decryptor.decrypt(ctxt_result, plain_result);
+  vector<double> decoded_result;
+  encoder.decode(plain_result, decoded_result);
+  cout << "Computed result: " << decoded_result[0] << endl;
+
+  PrecisionReport report;
+  report.add(decoded_result, ((3.1 + 4.1) * (5.9 * 5)) + 10);
+  report.print();
+
+  /*
+   * The circuit above has a single product, so there is nothing to defer. In a sum of products the eager schedule
+   * relinearizes and rescales every product; the lazy one adds them first and does both once, on the sum.
+   */
+  auto products = x * y + y * z + z * x;
+  CompiledCircuit eager = circuit.compile(products, context, scale);
+  CompiledCircuit lazy = eager.optimized();
+  print_line(__LINE__);
+  cout << "x*y + y*z + z*x: relinearizations: " << eager.count(CircuitOp::Kind::relinearize) << " eager, "
+       << lazy.count(CircuitOp::Kind::relinearize) << " lazy; rescales: " << eager.count(CircuitOp::Kind::rescale)
+       << " eager, " << lazy.count(CircuitOp::Kind::rescale) << " lazy" << endl;
+  lazy.print();
+  lazy.run(inputs, ctxt_result, evaluator, encoder, &relin_keys);
+  decryptor.decrypt(ctxt_result, plain_result);
+  encoder.decode(plain_result, decoded_result);
+  PrecisionReport lazy_report;
+  lazy_report.add(decoded_result, 3.1 * 4.1 + 4.1 * 5.9 + 5.9 * 3.1);
+  lazy_report.print();
+
+  /*
+   * CoeffModulus::Create picks the largest 30-bit primes, so every rescale moves the scale away from 2^30 (which is
+   * why modules 3a and 3b have to override it). A chain built for the scale keeps it much closer.
+   */
+  print_line(__LINE__);
+  double create_deviation = 0;
+  for (double level_scale : ModulusChain::LevelScales(context.key_context_data()->parms().coeff_modulus(), scale)) {
+    create_deviation = max(create_deviation, fabs(level_scale / scale - 1));
+  }
+  auto chain = ModulusChain::Create(16384, 30, 3, 30, 30);
+  cout << "Largest relative scale drift: " << create_deviation << " with CoeffModulus::Create, "
+       << chain.max_deviation << " with ModulusChain" << endl;
+
+  /*
+   * x*y*z + x adds values from different levels. With CoeffModulus::Create their scales differ by the drift, and
+   * told to realign, the compiler spends a multiplication by 1 and a rescale on x (by default it would throw). On
+   * the ModulusChain the difference is within chain.scale_tolerance(), and with ScaleMismatch::set_scale a
+   * set_scale absorbs it at a relative error no larger than that.
+   */
+  EncryptionParameters chain_parms(scheme_type::ckks);
+  chain_parms.set_poly_modulus_degree(16384);
+  chain_parms.set_coeff_modulus(chain.coeff_modulus);
+  auto chain_shared = SharedContext::get(chain_parms);
+  TracedEncryptor chain_encryptor(chain_shared->encryptor());
+  TracedEvaluator chain_evaluator(chain_shared->evaluator());
+  TracedDecryptor chain_decryptor(chain_shared->decryptor());
+  TracedEncoder chain_encoder(chain_shared->encoder());
+  auto mixed = x * y * z + x;
+  CompiledCircuit on_create = circuit.compile(mixed, context, scale, ScaleMismatch::realign);
+  CompiledCircuit on_chain = circuit.compile(mixed, chain_shared->context(), chain.scale, ScaleMismatch::set_scale,
+                                             chain.scale_tolerance());
+  print_line(__LINE__);
+  cout << "x*y*z + x: " << on_create.ops().size() << " instructions (" << on_create.count(CircuitOp::Kind::rescale)
+       << " rescales) with CoeffModulus::Create, " << on_chain.ops().size() << " ("
+       << on_chain.count(CircuitOp::Kind::rescale) << " rescales, " << on_chain.count(CircuitOp::Kind::set_scale)
+       << " set_scale) with ModulusChain:" << endl;
+  on_chain.print();
+
+  vector<Plaintext> chain_plains(3);
+  for (size_t i = 0; i < chain_plains.size(); i++) {
+    chain_encoder.encode(values[i], chain.scale, chain_plains[i]);
+  }
+  vector<Ciphertext> chain_inputs;
+  encrypt_many(chain_encryptor, chain_plains, chain_inputs);
+  Ciphertext ctxt_mixed;
+  on_chain.run(chain_inputs, ctxt_mixed, chain_evaluator, chain_encoder, &chain_shared->relin_keys());
+  chain_decryptor.decrypt(ctxt_mixed, plain_result);
+  chain_encoder.decode(plain_result, decoded_result);
+  PrecisionReport chain_report;
+  chain_report.add(decoded_result, 3.1 * 4.1 * 5.9 + 3.1);
+  chain_report.print();
+
+  /*
+   * Every slot computes the same thing above. Packing a different (x, y, z) row into every slot evaluates the
+   * circuit on slot_count rows per run; evaluateBatched splits longer columns into blocks and runs them in parallel.
+   */
+  size_t rows = 4 * encoder.slot_count() + 100;
+  vector<vector<double>> columns(3, vector<double>(rows));
+  for (size_t j = 0; j < columns.size(); j++) {
+    randomUniform(columns[j].data(), rows, default_random_seed, j);
+  }
+  print_line(__LINE__);
+  cout << "Evaluate " << rows << " rows in " << batchBlockCount(rows, encoder) << " blocks:" << endl;
+  auto start = chrono::high_resolution_clock::now();
+  PlaintextCache cache(encoder);
+  vector<double> batched =
+      evaluateBatched(compiled, columns, encryptor, decryptor, evaluator, encoder, &relin_keys, &cache);
+  auto stop = chrono::high_resolution_clock::now();
+  cout << "Took " << chrono::duration_cast<chrono::milliseconds>(stop - start).count() << " ms, constants encoded "
+       << cache.misses() << " times, reused " << cache.hits() << " times" << endl;
+
+  vector<cx_double> computed(batched.begin(), batched.end()), expected(rows);
+  for (size_t i = 0; i < rows; i++) {
+    expected[i] = ((columns[0][i] + columns[1][i]) * (columns[2][i] * 5)) + 10;
+  }
+  PrecisionReport batch_report;
+  batch_report.add(computed, expected);
+  batch_report.print();
+
+  /*
+   * Under a stream of blocks, run encoding, encryption, evaluation, decryption and decoding concurrently
+   */
+  print_line(__LINE__);
+  size_t stream_rows = 32 * encoder.slot_count() - encoder.slot_count() / 2; // the last block is half full
+  cout << "Stream " << stream_rows << " rows through the pipeline:" << endl;
+  {
+    Pipeline pipeline(compiled, encryptor, decryptor, evaluator, encoder, &relin_keys, PipelineOptions(), &cache);
+    thread producer([&] {
+      // One dataset per input column, each producing slot_count values at a time
+      vector<RandomDataset> datasets;
+      for (uint64_t j = 0; j < 3; j++) {
+        datasets.emplace_back(stream_rows, encoder.slot_count(), 1.0, sample_type::real, default_random_seed, j);
+      }
+      vector<cx_double> chunk;
+      for (uint64_t b = 0; b < datasets[0].chunk_count(); b++) {
+        vector<vector<double>> block;
+        for (auto &dataset : datasets) {
+          dataset.next(chunk);
+          block.emplace_back(chunk.size());
+          for (size_t i = 0; i < chunk.size(); i++) {
+            block.back()[i] = chunk[i].real();
+          }
+        }
+        pipeline.submit(move(block));
+      }
+      pipeline.close();
+    });
+    PipelineResult block_result;
+    while (pipeline.next(block_result)) {
+    }
+    producer.join();
+    pipeline.stats().print();
+  }
+
+  /*
+   * N = 16384 with five 30-bit primes is far more than this depth-1 circuit needs. Let the tuner measure what
+   * 20 bits of precision on inputs up to 6 actually cost.
+   */
+  print_line(__LINE__);
+  cout << "Tune parameters for 20 bits of precision:" << endl;
+  TunerRequirements requirements;
+  requirements.precision_bits = 20;
+  requirements.input_bound = 6;
+  vector<TunerCandidate> measured;
+  TunerCandidate best = tuneParameters(circuit, result, requirements, &measured);
+  for (auto const &candidate : measured) {
+    cout << "N = " << candidate.poly_modulus_degree << ", " << candidate.levels() << " levels of "
+         << candidate.scale_bits << " bits: " << candidate.seconds * 1000 << " ms, " << candidate.precision_bits
+         << " bits of precision" << endl;
+  }
+  cout << "Fastest: N = " << best.poly_modulus_degree << " with " << best.scale_bits << "-bit scale" << endl;
+}
@@ -0,0 +1,80 @@
+#include "modulus_chain.h"
+
+#include <seal/util/numth.h>
+
+#include <set>
+
+using namespace seal;
+
+namespace {
+
+// The prime p = 1 (mod step) closest to target with p < limit that is not in used
+std::uint64_t nearest_prime(double target, std::uint64_t step, std::uint64_t limit, std::set<std::uint64_t> const &used) {
+  // Candidates k * step + 1, visited in order of distance from target via one cursor on each side
+  std::uint64_t max_k = (limit - 2) / step;
+  auto below = static_cast<std::int64_t>(std::min<double>(std::floor((target - 1) / static_cast<double>(step)),
+                                                          static_cast<double>(max_k)));
+  std::int64_t above = below + 1;
+  while (below >= 1 || above <= static_cast<std::int64_t>(max_k)) {
+    double below_distance = target - static_cast<double>(below * step + 1);
+    double above_distance = static_cast<double>(above * step + 1) - target;
+    bool take_below = above > static_cast<std::int64_t>(max_k) || (below >= 1 && below_distance <= above_distance);
+    std::uint64_t p = static_cast<std::uint64_t>(take_below ? below-- : above++) * step + 1;
+    if (!used.count(p) && util::is_prime(Modulus(p))) {
+      return p;
+    }
+  }
+  throw std::invalid_argument("no NTT-friendly prime of the requested size");
+}
+
+} // namespace
+
+ModulusChain ModulusChain::Create(std::size_t poly_modulus_degree, int scale_bits, std::size_t levels, int first_bits,
+                                  int special_bits) {
+  if (scale_bits < 2 || scale_bits > 60 || first_bits > 60 || special_bits > 60) {
+    throw std::invalid_argument("prime sizes must be at most 60 bits");
+  }
+  std::uint64_t step = 2 * poly_modulus_degree;
+  std::set<std::uint64_t> used;
+
+  ModulusChain chain;
+  chain.scale = std::pow(2.0, scale_bits);
+  // Level primes may end up slightly above the scale, but SEAL takes at most 60-bit primes
+  std::uint64_t scale_limit = std::uint64_t(1) << std::min(scale_bits + 1, 60);
+
+  // Level primes from the top of the chain down: q_L is dropped by the first rescale
+  std::vector<std::uint64_t> level_primes(levels);
+  double s = chain.scale;
+  for (std::size_t i = levels; i-- > 0;) {
+    level_primes[i] = nearest_prime(s * s / chain.scale, step, scale_limit, used);
+    used.insert(level_primes[i]);
+    s = s * s / static_cast<double>(level_primes[i]);
+  }
+
+  std::uint64_t first = nearest_prime(std::pow(2.0, first_bits), step, std::uint64_t(1) << first_bits, used);
+  used.insert(first);
+  std::uint64_t special = nearest_prime(std::pow(2.0, special_bits), step, std::uint64_t(1) << special_bits, used);
+
+  chain.coeff_modulus.emplace_back(first);
+  for (auto p : level_primes) {
+    chain.coeff_modulus.emplace_back(p);
+  }
+  chain.coeff_modulus.emplace_back(special);
+
+  chain.level_scales = LevelScales(chain.coeff_modulus, chain.scale);
+  for (auto level_scale : chain.level_scales) {
+    chain.max_deviation = std::max(chain.max_deviation, std::fabs(level_scale / chain.scale - 1));
+  }
+  return chain;
+}
+
+std::vector<double> ModulusChain::LevelScales(std::vector<Modulus> const &coeff_modulus, double scale) {
+  // coeff_modulus = {q_0, ..., q_L, special}; fresh ciphertexts live at chain index L
+  std::size_t top = coeff_modulus.size() - 2;
+  std::vector<double> scales(top + 1);
+  scales[top] = scale;
+  for (std::size_t i = top; i > 0; i--) {
+    scales[i - 1] = scales[i] * scales[i] / static_cast<double>(coeff_modulus[i].value());
+  }
+  return scales;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "utils.h"
+
+/// A CKKS modulus chain whose primes are chosen for the scale rather than only for their bit size.
+/// CoeffModulus::Create takes the largest NTT-friendly primes below 2^bits, so every rescale moves the scale away
+/// from 2^bits and circuits either override scale() (adding an unbounded error) or spend levels to realign it.
+/// Here every prime q_i is the NTT-friendly prime closest to s_i^2 / scale, where s_i is the scale at chain index i
+/// when multiplying two values at that scale: q_i * scale tracks s_i^2, so s_(i-1) = s_i^2 / q_i returns to scale
+/// up to the prime spacing, at every level and without drifting.
+///
+///   auto chain = ModulusChain::Create(16384, 40, 3);
+///   parms.set_coeff_modulus(chain.coeff_modulus);
+///   auto compiled = circuit.compile(result, context, chain.scale, ScaleMismatch::set_scale, chain.scale_tolerance());
+struct ModulusChain {
+  std::vector<seal::Modulus> coeff_modulus; ///< first prime, one prime per level, special prime
+  double scale = 0;                         ///< scale of fresh ciphertexts (2^scale_bits)
+  std::vector<double> level_scales;         ///< level_scales[i]: scale at chain index i after a multiply and rescale
+  double max_deviation = 0;                 ///< largest |level_scales[i] / scale - 1|
+
+  /// Relative scale mismatch that values computed along different paths can end up with; pass it to
+  /// Circuit::compile to absorb these mismatches without extra levels. To first order every rescale moves a scale by
+  /// at most max_deviation away from the fresh scale, and these deviations add up. The factor 4 covers the two
+  /// operands of an addition each being up to two rescales off the other's path (e.g. x*y*z + x); additions of
+  /// values further apart exceed it and are realigned instead.
+  double scale_tolerance() const { return 4 * max_deviation; }
+
+  /// \param poly_modulus_degree Ring dimension N (primes are 1 mod 2N)
+  /// \param scale_bits log2 of the scale, at most 60
+  /// \param levels Number of rescales the chain supports
+  /// \param first_bits, special_bits Bit sizes of the first prime (holds the result) and the special prime
+  /// \throws std::invalid_argument if no suitable primes exist
+  static ModulusChain Create(std::size_t poly_modulus_degree, int scale_bits, std::size_t levels, int first_bits = 60,
+                             int special_bits = 60);
+
+  /// Scales along the same multiply-and-rescale path for an existing chain, e.g. one from CoeffModulus::Create
+  static std::vector<double> LevelScales(std::vector<seal::Modulus> const &coeff_modulus, double scale);
+};
@@ -0,0 +1,178 @@
+#include "pipeline.h"
+
+using namespace seal;
+
+struct Pipeline::Job {
+  std::size_t id = 0;
+  std::chrono::steady_clock::time_point submitted;
+  std::size_t rows = 0;
+  std::vector<std::vector<double>> values;
+  std::vector<Plaintext> plains;
+  std::vector<Ciphertext> ctxts;
+  Ciphertext result;
+  Plaintext plain_result;
+};
+
+void PipelineStats::print(std::ostream &os) const {
+  std::ios old_fmt(nullptr);
+  old_fmt.copyfmt(os);
+  os << std::fixed << std::setprecision(2) << blocks << " blocks in " << seconds << " s (" << blocks_per_second
+     << " blocks/s), latency p50 " << latency_p50 * 1000 << " ms, p99 " << latency_p99 * 1000 << " ms, max "
+     << latency_max * 1000 << " ms" << std::endl;
+  os.copyfmt(old_fmt);
+}
+
+template<class Work>
+void Pipeline::start_stage(std::size_t count, queue_type &in, queue_type &out, Work work) {
+  running_.push_back(std::make_unique<std::atomic<std::size_t>>(std::max<std::size_t>(count, 1)));
+  auto &running = *running_.back();
+  for (std::size_t t = 0; t < std::max<std::size_t>(count, 1); t++) {
+    workers_.emplace_back([this, &in, &out, &running, work] {
+      job_ptr job;
+      while (in.pop(job)) {
+        try {
+          work(*job);
+          out.push(std::move(job));
+        } catch (...) {
+          // The block is dropped; next() reports the error once the remaining blocks are through
+          std::lock_guard<std::mutex> lock(mutex_);
+          if (!error_) {
+            error_ = std::current_exception();
+          }
+        }
+      }
+      if (--running == 0) {
+        out.close();
+      }
+    });
+  }
+}
+
+Pipeline::Pipeline(CompiledCircuit const &circuit, Encryptor const &encryptor, Decryptor &decryptor,
+                   Evaluator const &evaluator, CKKSEncoder const &encoder, RelinKeys const *relin_keys,
+                   PipelineOptions const &options, PlaintextCache *cache)
+    : circuit_(circuit), encryptor_(encryptor), decryptor_(decryptor), evaluator_(evaluator), encoder_(encoder),
+      relin_keys_(relin_keys), cache_(cache) {
+  for (int i = 0; i < 6; i++) {
+    queues_.push_back(std::make_unique<queue_type>(options.queue_capacity));
+  }
+
+  start_stage(options.encode_threads, *queues_[0], *queues_[1], [this](Job &job) {
+    job.plains.resize(job.values.size());
+    for (std::size_t j = 0; j < job.values.size(); j++) {
+      TraceScope scope("encode", "encoder");
+      encoder_.encode(job.values[j], circuit_.input_scale(), job.plains[j]);
+    }
+    job.values.clear();
+  });
+  start_stage(options.encrypt_threads, *queues_[1], *queues_[2], [this](Job &job) {
+    job.ctxts.resize(job.plains.size());
+    for (std::size_t j = 0; j < job.plains.size(); j++) {
+      TraceScope scope("encrypt", "encryptor");
+      encryptor_.encrypt(job.plains[j], job.ctxts[j]);
+      scope.set(job.ctxts[j]);
+    }
+    job.plains.clear();
+  });
+  start_stage(options.evaluate_threads, *queues_[2], *queues_[3], [this](Job &job) {
+    circuit_.run(job.ctxts, job.result, evaluator_, encoder_, relin_keys_, cache_);
+    job.ctxts.clear();
+  });
+  start_stage(options.decrypt_threads, *queues_[3], *queues_[4], [this](Job &job) {
+    TraceScope scope("decrypt", "decryptor", job.result);
+    decryptor_.decrypt(job.result, job.plain_result);
+  });
+  start_stage(options.decode_threads, *queues_[4], *queues_[5], [this](Job &job) {
+    job.values.resize(1);
+    {
+      TraceScope scope("decode", "encoder");
+      encoder_.decode(job.plain_result, job.values[0]);
+    }
+    job.values[0].resize(job.rows);
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    latencies_.push_back(std::chrono::duration<double>(now - job.submitted).count());
+    last_finish_ = std::max(last_finish_, now);
+  });
+}
+
+Pipeline::~Pipeline() {
+  close();
+  // Drain the results so no stage is left waiting for room
+  job_ptr job;
+  while (queues_.back()->pop(job)) {
+  }
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+std::size_t Pipeline::submit(std::vector<std::vector<double>> inputs) {
+  if (closed_) {
+    throw std::invalid_argument("pipeline is closed");
+  }
+  if (inputs.size() != circuit_.input_count()) {
+    throw std::invalid_argument("need one column per circuit input");
+  }
+  auto job = std::make_unique<Job>();
+  for (auto const &column : inputs) {
+    if (column.size() > encoder_.slot_count()) {
+      throw std::invalid_argument("block has more values than slots");
+    }
+    job->rows = std::max(job->rows, column.size());
+  }
+  job->id = next_id_++;
+  job->submitted = std::chrono::steady_clock::now();
+  std::call_once(first_submit_flag_, [&] { first_submit_ = job->submitted; });
+  job->values = std::move(inputs);
+  std::size_t id = job->id;
+  queues_[0]->push(std::move(job));
+  return id;
+}
+
+void Pipeline::close() {
+  if (!closed_.exchange(true)) {
+    queues_[0]->close();
+  }
+}
+
+bool Pipeline::next(PipelineResult &result) {
+  job_ptr job;
+  if (!queues_.back()->pop(job)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return false;
+  }
+  result.id = job->id;
+  result.values = std::move(job->values[0]);
+  result.latency_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job->submitted).count();
+  return true;
+}
+
+PipelineStats Pipeline::stats() const {
+  PipelineStats stats;
+  std::vector<double> latencies;
+  std::chrono::steady_clock::time_point last_finish;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    latencies = latencies_;
+    last_finish = last_finish_;
+  }
+  stats.blocks = latencies.size();
+  if (latencies.empty()) {
+    return stats;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto quantile = [&](double q) {
+    std::size_t rank = static_cast<std::size_t>(std::ceil(q * latencies.size()));
+    return latencies[std::min(latencies.size(), std::max<std::size_t>(rank, 1)) - 1];
+  };
+  stats.seconds = std::chrono::duration<double>(last_finish - first_submit_).count();
+  stats.blocks_per_second = stats.seconds > 0 ? stats.blocks / stats.seconds : 0;
+  stats.latency_p50 = quantile(0.5);
+  stats.latency_p99 = quantile(0.99);
+  stats.latency_max = latencies.back();
+  return stats;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "circuit.h"
+
+#include <atomic>
+#include <exception>
+
+/// Bounded multi-producer multi-consumer queue (Vyukov's array-based design): every cell carries a sequence number,
+/// so producers and consumers only contend on one atomic position each and never take a lock. push() and pop()
+/// wait with exponential backoff (spin, yield, then short sleeps) so idle stages do not steal cores from busy ones.
+template<class T>
+class BoundedQueue {
+ public:
+  /// \param capacity Rounded up to a power of two
+  explicit BoundedQueue(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (std::size_t i = 0; i < size; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /// Move value into the queue if there is room
+  bool try_push(T &value) {
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.data = std::move(value);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Move the oldest element into value if there is one
+  bool try_pop(T &value) {
+    std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.data);
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Wait until there is room, then move value into the queue
+  void push(T value) {
+    for (std::size_t attempt = 0; !try_push(value); attempt++) {
+      backoff(attempt);
+    }
+  }
+
+  /// Wait for an element; returns false once the queue is closed and empty
+  bool pop(T &value) {
+    for (std::size_t attempt = 0;; attempt++) {
+      if (try_pop(value)) {
+        return true;
+      }
+      if (closed_.load(std::memory_order_acquire)) {
+        return try_pop(value);
+      }
+      backoff(attempt);
+    }
+  }
+
+  /// No more pushes will follow; consumers drain the queue and then stop
+  void close() { closed_.store(true, std::memory_order_release); }
+
+ private:
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    T data;
+  };
+
+  static void backoff(std::size_t attempt) {
+    if (attempt < 64) {
+      return;
+    }
+    if (attempt < 128) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  std::unique_ptr<Cell[]> cells_;
+  std::size_t mask_ = 0;
+  alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<std::size_t> dequeue_pos_{0};
+  alignas(64) std::atomic<bool> closed_{false};
+};
+
+/// Worker threads per stage and queue capacity of a Pipeline
+struct PipelineOptions {
+  std::size_t queue_capacity = 16;
+  std::size_t encode_threads = 1;
+  std::size_t encrypt_threads = 1;
+  std::size_t evaluate_threads = std::max(4u, std::thread::hardware_concurrency()) - 3; ///< the rest of the cores
+  std::size_t decrypt_threads = 1;
+  std::size_t decode_threads = 1;
+};
+
+/// One finished block
+struct PipelineResult {
+  std::size_t id = 0;             ///< value returned by Pipeline::submit
+  std::vector<double> values;     ///< the circuit's result per slot (as many as the longest input column)
+  double latency_seconds = 0;     ///< time from submit to the end of decoding
+};
+
+/// Throughput and latency of the blocks finished so far
+struct PipelineStats {
+  std::size_t blocks = 0;
+  double seconds = 0;             ///< from the first submit to the last finished block
+  double blocks_per_second = 0;
+  double latency_p50 = 0;         ///< seconds
+  double latency_p99 = 0;
+  double latency_max = 0;
+
+  void print(std::ostream &os = std::cout) const;
+};
+
+/// Runs a compiled circuit on a stream of input blocks with every stage (encode, encrypt, evaluate, decrypt,
+/// decode) on its own worker threads, connected by bounded lock-free queues. A full queue makes the stage in front
+/// of it wait, so memory stays bounded under sustained load.
+///
+///   Pipeline pipeline(compiled, encryptor, decryptor, evaluator, encoder, &relin_keys);
+///   std::thread producer([&] { for (auto &block : blocks) pipeline.submit(block); pipeline.close(); });
+///   PipelineResult result;
+///   while (pipeline.next(result)) { ... }
+class Pipeline {
+ public:
+  /// All references must outlive the pipeline
+  Pipeline(CompiledCircuit const &circuit, seal::Encryptor const &encryptor, seal::Decryptor &decryptor,
+           seal::Evaluator const &evaluator, seal::CKKSEncoder const &encoder,
+           seal::RelinKeys const *relin_keys = nullptr, PipelineOptions const &options = PipelineOptions(),
+           PlaintextCache *cache = nullptr);
+
+  /// Closes the pipeline and waits for the workers; unclaimed results are dropped
+  ~Pipeline();
+
+  Pipeline(Pipeline const &) = delete;
+  Pipeline &operator=(Pipeline const &) = delete;
+
+  /// Queue one block, waiting while the encode queue is full
+  /// \param inputs One column per circuit input, at most slot_count values each
+  /// \return Id of the block, counting from 0
+  /// \throws std::invalid_argument if the inputs do not fit the circuit
+  std::size_t submit(std::vector<std::vector<double>> inputs);
+
+  /// No more blocks will be submitted
+  void close();
+
+  /// Wait for the next finished block (in completion order, not submit order)
+  /// \return false once the pipeline is closed and every block has been returned
+  /// \throws The first exception thrown by any stage
+  bool next(PipelineResult &result);
+
+  PipelineStats stats() const;
+
+ private:
+  struct Job;
+  typedef std::unique_ptr<Job> job_ptr;
+  typedef BoundedQueue<job_ptr> queue_type;
+
+  // Start count workers that pop from in, apply work and push to out; the last one to finish closes out
+  template<class Work>
+  void start_stage(std::size_t count, queue_type &in, queue_type &out, Work work);
+
+  CompiledCircuit const &circuit_;
+  seal::Encryptor const &encryptor_;
+  seal::Decryptor &decryptor_;
+  seal::Evaluator const &evaluator_;
+  seal::CKKSEncoder const &encoder_;
+  seal::RelinKeys const *relin_keys_;
+  PlaintextCache *cache_;
+
+  std::vector<std::unique_ptr<queue_type>> queues_; // queues_[i] feeds stage i, the last one holds results
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<std::atomic<std::size_t>>> running_; // live workers per stage
+
+  std::atomic<std::size_t> next_id_{0};
+  std::atomic<bool> closed_{false};
+  std::chrono::steady_clock::time_point first_submit_;
+  std::once_flag first_submit_flag_;
+
+  mutable std::mutex mutex_; // guards the members below
+  std::exception_ptr error_;
+  std::vector<double> latencies_;
+  std::chrono::steady_clock::time_point last_finish_;
+};
@@ -0,0 +1,116 @@
+#include "plain_operand.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace seal;
+
+PlainOperand::PlainOperand(SEALContext const &context, CKKSEncoder const &encoder, double value, double scale)
+    : context_(context), scale_(scale) {
+  encoder.encode(value, context.first_parms_id(), scale, top_);
+  levels_.resize(context.first_context_data()->chain_index() + 1);
+}
+
+PlainOperand::PlainOperand(SEALContext const &context, CKKSEncoder const &encoder,
+                           std::vector<double> const &values, double scale)
+    : context_(context), scale_(scale) {
+  encoder.encode(values, context.first_parms_id(), scale, top_);
+  levels_.resize(context.first_context_data()->chain_index() + 1);
+}
+
+PlainOperand::PlainOperand(SEALContext const &context, CKKSEncoder const &encoder,
+                           std::vector<cx_double> const &values, double scale)
+    : context_(context), scale_(scale) {
+  encoder.encode(values, context.first_parms_id(), scale, top_);
+  levels_.resize(context.first_context_data()->chain_index() + 1);
+}
+
+SEALContext::ContextData const &PlainOperand::level(parms_id_type const &parms_id) const {
+  auto context_data = context_.get_context_data(parms_id);
+  if (!context_data || context_data->chain_index() >= levels_.size()) {
+    throw std::invalid_argument("parms_id is not a data level of the operand's context");
+  }
+  return *context_data;
+}
+
+void PlainOperand::check_ciphertext(Ciphertext const &ctxt) const {
+  level(ctxt.parms_id());
+  if (!ctxt.is_ntt_form()) {
+    throw std::invalid_argument("ciphertext must be in NTT form");
+  }
+}
+
+void PlainOperand::check_scale(Ciphertext const &ctxt) const {
+  // Same test as Evaluator::add_plain
+  double tolerance = std::numeric_limits<double>::epsilon() * std::max({std::fabs(ctxt.scale()), scale_, 1.0});
+  if (std::fabs(ctxt.scale() - scale_) >= tolerance) {
+    throw std::invalid_argument("scale mismatch");
+  }
+}
+
+void PlainOperand::multiply_plain_inplace(Ciphertext &ctxt) const {
+  check_ciphertext(ctxt);
+  auto const &context_data = level(ctxt.parms_id());
+  auto const &parms = context_data.parms();
+  double new_scale = ctxt.scale() * scale_;
+  if (std::log2(new_scale) >= context_data.total_coeff_modulus_bit_count()) {
+    throw std::invalid_argument("scale out of bounds");
+  }
+
+  TraceScope scope("multiply_plain", "evaluator", ctxt);
+  for (size_t j = 0; j < ctxt.size(); j++) {
+    multiply(ctxt.data(j), top_.data(), parms.poly_modulus_degree(), parms.coeff_modulus(), ctxt.data(j));
+  }
+  ctxt.scale() = new_scale;
+}
+
+void PlainOperand::add_plain_inplace(Ciphertext &ctxt) const {
+  check_ciphertext(ctxt);
+  check_scale(ctxt);
+  auto const &parms = level(ctxt.parms_id()).parms();
+
+  TraceScope scope("add_plain", "evaluator", ctxt);
+  add(ctxt.data(0), top_.data(), parms.poly_modulus_degree(), parms.coeff_modulus(), ctxt.data(0));
+}
+
+void PlainOperand::sub_plain_inplace(Ciphertext &ctxt) const {
+  check_ciphertext(ctxt);
+  check_scale(ctxt);
+  auto const &parms = level(ctxt.parms_id()).parms();
+
+  TraceScope scope("sub_plain", "evaluator", ctxt);
+  sub(ctxt.data(0), top_.data(), parms.poly_modulus_degree(), parms.coeff_modulus(), ctxt.data(0));
+}
+
+Plaintext const &PlainOperand::plaintext(parms_id_type const &parms_id) const {
+  if (parms_id == top_.parms_id()) {
+    return top_;
+  }
+  auto const &context_data = level(parms_id);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &plain = levels_[context_data.chain_index()];
+  if (!plain) {
+    // Same as Evaluator::mod_switch_to for NTT-form plaintexts: keep the leading RNS components
+    auto const &parms = context_data.parms();
+    size_t count = parms.poly_modulus_degree() * parms.coeff_modulus().size();
+    plain = std::make_unique<Plaintext>();
+    plain->resize(count);
+    std::copy_n(top_.data(), count, plain->data());
+    plain->parms_id() = parms_id;
+    plain->scale() = scale_;
+  }
+  return *plain;
+}
+
+std::size_t PlainOperand::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::size_t count = top_.coeff_count();
+  for (auto const &plain : levels_) {
+    if (plain) {
+      count += plain->coeff_count();
+    }
+  }
+  return count * sizeof(std::uint64_t);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "utils.h"
+
+#include <memory>
+#include <mutex>
+
+/// A CKKS plaintext constant that is prepared once and can then be used at every level of the chain.
+/// The encoder rounds scale * values to integer coefficients and stores them in NTT form modulo each prime.
+/// Those integers do not depend on the level, so the NTT form at chain index i is the first i + 1 RNS
+/// components of the form at the top of the chain. The operand encodes once at the first data level and
+/// keeps only that one copy. multiply_plain and add_plain at any lower level then run a dyadic product or
+/// sum over a prefix of it, with no re-encoding and no mod switch.
+///
+///   PlainOperand five(context, encoder, 5.0, scale);
+///   five.multiply_plain_inplace(ctxt);  // valid at any level
+///
+/// Encoding at the top of the chain requires |scale * value| to fit at every level where the operand is used.
+/// This holds whenever encoding at that level directly would succeed.
+class PlainOperand {
+ public:
+  /// value encoded in every slot
+  /// \param context, encoder Must outlive the operand
+  PlainOperand(seal::SEALContext const &context, seal::CKKSEncoder const &encoder, double value, double scale);
+
+  /// values encoded slot-wise (missing slots are zero)
+  PlainOperand(seal::SEALContext const &context, seal::CKKSEncoder const &encoder,
+               std::vector<double> const &values, double scale);
+
+  /// values encoded slot-wise (missing slots are zero)
+  PlainOperand(seal::SEALContext const &context, seal::CKKSEncoder const &encoder,
+               std::vector<cx_double> const &values, double scale);
+
+  double scale() const { return scale_; }
+
+  /// ctxt *= operand; the scale of ctxt is multiplied by scale()
+  /// \throws std::invalid_argument if ctxt is not an NTT-form ciphertext of this chain or the scale overflows
+  void multiply_plain_inplace(seal::Ciphertext &ctxt) const;
+
+  /// ctxt += operand
+  /// \throws std::invalid_argument if ctxt is not an NTT-form ciphertext of this chain or the scales differ
+  void add_plain_inplace(seal::Ciphertext &ctxt) const;
+
+  /// ctxt -= operand
+  /// \throws std::invalid_argument if ctxt is not an NTT-form ciphertext of this chain or the scales differ
+  void sub_plain_inplace(seal::Ciphertext &ctxt) const;
+
+  /// The operand as a Plaintext at the given level, for APIs that take one. Each level's Plaintext is copied
+  /// out of the top-level form the first time it is requested. Thread-safe.
+  seal::Plaintext const &plaintext(seal::parms_id_type const &parms_id) const;
+
+  /// Bytes held by the operand, including the levels materialized by plaintext()
+  std::size_t bytes() const;
+
+ private:
+  // Context data of a ciphertext or level this operand can be applied to
+  seal::SEALContext::ContextData const &level(seal::parms_id_type const &parms_id) const;
+
+  void check_ciphertext(seal::Ciphertext const &ctxt) const;
+
+  void check_scale(seal::Ciphertext const &ctxt) const;
+
+  seal::SEALContext const &context_;
+  double scale_;
+  seal::Plaintext top_; // NTT form at context_.first_parms_id()
+  mutable std::mutex mutex_;
+  mutable std::vector<std::unique_ptr<seal::Plaintext>> levels_; // indexed by chain index
+};
@@ -0,0 +1,130 @@
+#include "plaintext_cache.h"
+#include "trace.h"
+
+#include <cstring>
+
+using namespace seal;
+
+namespace {
+
+// FNV-1a over the raw bytes
+std::size_t hash_bytes(void const *data, std::size_t len, std::size_t h) {
+  auto bytes = static_cast<unsigned char const *>(data);
+  for (std::size_t i = 0; i < len; i++) {
+    h = (h ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+} // namespace
+
+PlaintextCache::PlaintextCache(CKKSEncoder const &encoder, std::size_t max_bytes)
+    : encoder_(encoder), max_bytes_(max_bytes) {}
+
+bool PlaintextCache::Key::operator==(Key const &other) const {
+  return hash == other.hash && broadcast == other.broadcast && parms_id == other.parms_id
+      && std::memcmp(&scale, &other.scale, sizeof(scale)) == 0 && values.size() == other.values.size()
+      && std::memcmp(values.data(), other.values.data(), values.size() * sizeof(cx_double)) == 0;
+}
+
+PlaintextCache::Key PlaintextCache::make_key(std::vector<cx_double> values, bool broadcast,
+                                             parms_id_type const &parms_id, double scale) {
+  // Compare bit patterns, but treat -0.0 like 0.0 since both encode the same
+  for (auto &v : values) {
+    v = cx_double(v.real() + 0.0, v.imag() + 0.0);
+  }
+  std::size_t h = 0xcbf29ce484222325ULL;
+  h = hash_bytes(values.data(), values.size() * sizeof(cx_double), h);
+  h = hash_bytes(&broadcast, sizeof(broadcast), h);
+  h = hash_bytes(parms_id.data(), parms_id.size() * sizeof(parms_id[0]), h);
+  h = hash_bytes(&scale, sizeof(scale), h);
+  return Key{std::move(values), broadcast, parms_id, scale, h};
+}
+
+std::shared_ptr<Plaintext const> PlaintextCache::get(double value, parms_id_type const &parms_id, double scale) {
+  return lookup(make_key({cx_double(value, 0.0)}, true, parms_id, scale));
+}
+
+std::shared_ptr<Plaintext const> PlaintextCache::get(cx_double value, parms_id_type const &parms_id, double scale) {
+  return lookup(make_key({value}, true, parms_id, scale));
+}
+
+std::shared_ptr<Plaintext const> PlaintextCache::get(std::vector<double> const &values,
+                                                     parms_id_type const &parms_id, double scale) {
+  return lookup(make_key(std::vector<cx_double>(values.begin(), values.end()), false, parms_id, scale));
+}
+
+std::shared_ptr<Plaintext const> PlaintextCache::get(std::vector<cx_double> const &values,
+                                                     parms_id_type const &parms_id, double scale) {
+  return lookup(make_key(values, false, parms_id, scale));
+}
+
+std::shared_ptr<Plaintext const> PlaintextCache::lookup(Key key) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      hits_++;
+      return it->second->plain;
+    }
+    misses_++;
+  }
+
+  // Encode without holding the lock; if another thread encoded the same key meanwhile, its entry wins
+  auto plain = std::make_shared<Plaintext>();
+  TraceScope scope("encode", "encoder");
+  if (key.broadcast) {
+    encoder_.encode(key.values[0], key.parms_id, key.scale, *plain);
+  } else {
+    encoder_.encode(key.values, key.parms_id, key.scale, *plain);
+  }
+  // The values are held twice, by the list entry and by the index
+  std::size_t bytes = plain->coeff_count() * sizeof(std::uint64_t) + 2 * key.values.size() * sizeof(cx_double);
+  if (bytes > max_bytes_) {
+    return plain;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->plain;
+  }
+  while (bytes_ + bytes > max_bytes_) {
+    bytes_ -= lru_.back().bytes;
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+  lru_.push_front(Entry{key, plain, bytes});
+  index_.emplace(std::move(key), lru_.begin());
+  bytes_ += bytes;
+  return plain;
+}
+
+void PlaintextCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  lru_.clear();
+  bytes_ = 0;
+}
+
+std::size_t PlaintextCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lru_.size();
+}
+
+std::size_t PlaintextCache::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+std::size_t PlaintextCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+std::size_t PlaintextCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
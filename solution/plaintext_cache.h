@@ -0,0 +1,83 @@
+#pragma once
+
+#include "utils.h"
+
+#include <list>
+#include <unordered_map>
+
+/// Thread-safe cache of encoded CKKS plaintexts, keyed by the encoded values, the scale and the parms_id.
+/// Encoding a constant costs an inverse FFT plus one NTT per prime; circuits that reuse a handful of constants
+/// only pay that once per (value, scale, level). Least recently used entries are evicted once the encoded
+/// plaintexts exceed the memory cap. Entries are handed out as shared pointers, so eviction never invalidates a
+/// plaintext that is still in use.
+///
+///   PlaintextCache cache(encoder);
+///   evaluator.multiply_plain_inplace(ctxt, *cache.get(5.0, ctxt.parms_id(), scale));
+class PlaintextCache {
+ public:
+  /// \param encoder Encoder used on misses; must outlive the cache
+  /// \param max_bytes Memory cap for the cached plaintexts (0 disables caching)
+  explicit PlaintextCache(seal::CKKSEncoder const &encoder, std::size_t max_bytes = std::size_t(64) << 20);
+
+  /// value encoded in every slot
+  std::shared_ptr<seal::Plaintext const> get(double value, seal::parms_id_type const &parms_id, double scale);
+
+  /// value encoded in every slot
+  std::shared_ptr<seal::Plaintext const> get(cx_double value, seal::parms_id_type const &parms_id, double scale);
+
+  /// values encoded slot-wise (missing slots are zero)
+  std::shared_ptr<seal::Plaintext const> get(std::vector<double> const &values, seal::parms_id_type const &parms_id,
+                                             double scale);
+
+  /// values encoded slot-wise (missing slots are zero)
+  std::shared_ptr<seal::Plaintext const> get(std::vector<cx_double> const &values,
+                                             seal::parms_id_type const &parms_id, double scale);
+
+  /// Drop all entries
+  void clear();
+
+  /// Number of cached plaintexts
+  std::size_t size() const;
+
+  /// Bytes used by the cached plaintexts
+  std::size_t bytes() const;
+
+  std::size_t hits() const;
+  std::size_t misses() const;
+
+ private:
+  // Scalars are stored as a single value with broadcast set, so 5.0 and {5.0} are different keys
+  struct Key {
+    std::vector<cx_double> values;
+    bool broadcast;
+    seal::parms_id_type parms_id;
+    double scale;
+    std::size_t hash;
+
+    bool operator==(Key const &other) const;
+  };
+
+  struct KeyHash {
+    std::size_t operator()(Key const &key) const { return key.hash; }
+  };
+
+  struct Entry {
+    Key key;
+    std::shared_ptr<seal::Plaintext const> plain;
+    std::size_t bytes;
+  };
+
+  static Key make_key(std::vector<cx_double> values, bool broadcast, seal::parms_id_type const &parms_id,
+                      double scale);
+
+  std::shared_ptr<seal::Plaintext const> lookup(Key key);
+
+  seal::CKKSEncoder const &encoder_;
+  std::size_t max_bytes_;
+  mutable std::mutex mutex_;
+  std::list<Entry> lru_; // most recently used first
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+  std::size_t bytes_ = 0;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+};
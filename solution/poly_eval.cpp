@@ -0,0 +1,293 @@
+#include "poly_eval.h"
+
+#include <map>
+#include <set>
+
+using namespace seal;
+
+namespace {
+
+// Degree of the polynomial with the given coefficients, ignoring leading zeros (0 for constants)
+size_t degree_of(double const* coeffs, size_t count) {
+  while (count > 1 && coeffs[count - 1] == 0) {
+    count--;
+  }
+  return count ? count - 1 : 0;
+}
+
+size_t ceil_log2(size_t i) {
+  size_t bits = 0;
+  while ((size_t(1) << bits) < i) {
+    bits++;
+  }
+  return bits;
+}
+
+// x^i is computed as x^p * x^(i-p) for the largest power of two p < i, which needs ceil(log2(i)) levels
+size_t split_power(size_t i) {
+  size_t p = 1;
+  while (2 * p < i) {
+    p *= 2;
+  }
+  return p;
+}
+
+// Largest giant step k * 2^j that does not exceed degree (requires degree >= k)
+size_t giant_step(size_t degree, size_t k) {
+  size_t giant = k;
+  while (2 * giant <= degree) {
+    giant *= 2;
+  }
+  return giant;
+}
+
+// Dry run of PolynomialEvaluator::evaluate_range for baby step k: records the powers of x that are needed
+// and the number of ciphertext-ciphertext products between sub-polynomials; returns the depth
+struct Shape {
+  size_t k;
+  std::set<size_t> powers;
+  size_t products = 0;
+
+  void require(size_t i) {
+    if (powers.count(i)) {
+      return;
+    }
+    if (i > 1) {
+      size_t p = split_power(i);
+      require(p);
+      require(i - p);
+    }
+    powers.insert(i);
+  }
+
+  size_t analyse(double const* coeffs, size_t count) {
+    size_t degree = degree_of(coeffs, count);
+    if (degree == 0) {
+      return 0;
+    }
+    if (degree < k) {
+      size_t depth = 0;
+      for (size_t i = 1; i <= degree; i++) {
+        if (coeffs[i] != 0) {
+          require(i);
+          depth = std::max(depth, ceil_log2(i));
+        }
+      }
+      return depth + 1;
+    }
+
+    size_t giant = giant_step(degree, k);
+    require(giant);
+    size_t top = ceil_log2(giant);
+    if (degree_of(coeffs + giant, count - giant) > 0) {
+      products++;
+      top = std::max(top, analyse(coeffs + giant, count - giant));
+    }
+    return std::max(top + 1, analyse(coeffs, giant));
+  }
+};
+
+} // namespace
+
+PolyEvalPlan PolyEvalPlan::Create(std::vector<double> const& coeffs, size_t depth_budget) {
+  size_t degree = degree_of(coeffs.data(), coeffs.size());
+  std::vector<PolyEvalPlan> candidates;
+  if (degree == 0) {
+    candidates.emplace_back();
+    return candidates[0];
+  }
+
+  // k > degree means plain power basis evaluation, so that is the last candidate
+  size_t min_depth = std::numeric_limits<size_t>::max();
+  for (size_t k = 2; k / 2 <= degree; k *= 2) {
+    Shape shape;
+    shape.k = k;
+    PolyEvalPlan plan;
+    plan.degree = degree;
+    plan.baby_step = k;
+    plan.depth = shape.analyse(coeffs.data(), degree + 1);
+    plan.nonscalar_mults = shape.powers.size() - 1 + shape.products;
+    plan.giant_steps = static_cast<size_t>(std::count_if(shape.powers.begin(), shape.powers.end(),
+                                                         [k](size_t i) { return i >= k; }));
+    min_depth = std::min(min_depth, plan.depth);
+    candidates.push_back(plan);
+  }
+
+  depth_budget = std::max(depth_budget, min_depth);
+  PolyEvalPlan const* best = nullptr;
+  for (auto const& plan : candidates) {
+    if (plan.depth <= depth_budget &&
+        (!best || plan.nonscalar_mults < best->nonscalar_mults ||
+         (plan.nonscalar_mults == best->nonscalar_mults && plan.depth < best->depth))) {
+      best = &plan;
+    }
+  }
+  return *best;
+}
+
+struct PolynomialEvaluator::Powers {
+  size_t k;
+  std::map<size_t, Ciphertext> cache;
+};
+
+PolynomialEvaluator::PolynomialEvaluator(SEALContext const& context, Evaluator const& evaluator,
+                                         CKKSEncoder const& encoder, RelinKeys const& relin_keys,
+                                         PlaintextCache* cache)
+    : context_(context), evaluator_(evaluator), encoder_(encoder), relin_keys_(relin_keys), cache_(cache) {
+  auto context_data = context_.first_context_data();
+  parms_ids_.resize(context_data->chain_index() + 1);
+  for (; context_data; context_data = context_data->next_context_data()) {
+    parms_ids_[context_data->chain_index()] = context_data->parms_id();
+  }
+}
+
+void PolynomialEvaluator::evaluate(Ciphertext const& x, std::vector<double> const& coeffs, Ciphertext& result,
+                                   size_t depth_budget) const {
+  auto plan = PolyEvalPlan::Create(coeffs, depth_budget);
+  if (plan.degree == 0) {
+    throw std::invalid_argument("polynomial must have degree at least 1");
+  }
+  size_t chain_index = context_.get_context_data(x.parms_id())->chain_index();
+  if (plan.depth > chain_index) {
+    throw std::invalid_argument("ciphertext does not have enough levels left to evaluate the polynomial");
+  }
+
+  TraceScope scope("polynomial", "evaluator", x);
+  Powers powers{plan.baby_step, {}};
+  powers.cache.emplace(1, x);
+  evaluate_range(powers, coeffs.data(), plan.degree + 1, chain_index - plan.depth, x.scale(), result);
+}
+
+Ciphertext const& PolynomialEvaluator::power(Powers& powers, size_t i) const {
+  auto it = powers.cache.find(i);
+  if (it != powers.cache.end()) {
+    return it->second;
+  }
+
+  size_t p = split_power(i);
+  Ciphertext const& a = power(powers, p);
+  Ciphertext const& b = power(powers, i - p);
+
+  TraceScope scope("power", "evaluator");
+  Ciphertext result;
+  if (p == i - p) {
+    evaluator_.square(a, result);
+  } else {
+    // Bring both factors to the lower of their levels
+    size_t level = std::min(context_.get_context_data(a.parms_id())->chain_index(),
+                            context_.get_context_data(b.parms_id())->chain_index());
+    Ciphertext a_low, b_low;
+    evaluator_.mod_switch_to(a, parms_ids_[level], a_low);
+    evaluator_.mod_switch_to(b, parms_ids_[level], b_low);
+    evaluator_.multiply(a_low, b_low, result);
+  }
+  evaluator_.relinearize_inplace(result, relin_keys_);
+  evaluator_.rescale_to_next_inplace(result);
+  scope.set(result);
+  return powers.cache.emplace(i, std::move(result)).first->second;
+}
+
+std::shared_ptr<Plaintext const> PolynomialEvaluator::encode(double value, parms_id_type const& parms_id,
+                                                             double scale) const {
+  if (cache_) {
+    return cache_->get(value, parms_id, scale);
+  }
+  TraceScope scope("encode", "encoder");
+  auto plain = std::make_shared<Plaintext>();
+  encoder_.encode(value, parms_id, scale, *plain);
+  return plain;
+}
+
+// result = value * a at the given level and scale. The constant is encoded at exactly the scale that turns
+// the scale of a into the requested one, so terms of different origin can be added without scale overrides.
+void PolynomialEvaluator::multiply_const(Ciphertext const& a, double value, size_t chain_index, double scale,
+                                         Ciphertext& result) const {
+  double plain_scale = scale / a.scale();
+  if (plain_scale < 1) {
+    throw std::invalid_argument("constant would need a plaintext scale below 1; use a larger scale or more levels");
+  }
+  evaluator_.mod_switch_to(a, parms_ids_[chain_index], result);
+  evaluator_.multiply_plain_inplace(result, *encode(value, parms_ids_[chain_index], plain_scale));
+  result.scale() = scale; // a.scale() * (scale / a.scale()) only differs from scale by floating-point rounding
+}
+
+// Evaluate the polynomial with the given coefficients (degree >= 1) such that the result ends up at
+// exactly the given level and scale. Every product happens one level higher and is rescaled down, so
+// the operands of a product are evaluated at (chain_index + 1, scale * q / <scale of the other operand>),
+// where q is the prime dropped by that rescale.
+void PolynomialEvaluator::evaluate_range(Powers& powers, double const* coeffs, size_t count, size_t chain_index,
+                                         double scale, Ciphertext& result) const {
+  size_t degree = degree_of(coeffs, count);
+  double upper_scale = scale * static_cast<double>(
+      context_.get_context_data(parms_ids_[chain_index + 1])->parms().coeff_modulus().back().value());
+
+  if (degree < powers.k) {
+    // Leaf: linear combination of the baby steps
+    bool first = true;
+    for (size_t i = 1; i <= degree; i++) {
+      if (coeffs[i] == 0) {
+        continue;
+      }
+      Ciphertext term;
+      multiply_const(power(powers, i), coeffs[i], chain_index + 1, upper_scale, term);
+      if (first) {
+        result = std::move(term);
+        first = false;
+      } else {
+        evaluator_.add_inplace(result, term);
+      }
+    }
+  } else {
+    // p = q * x^giant + r
+    size_t giant = giant_step(degree, powers.k);
+    Ciphertext const& x_giant = power(powers, giant);
+    double const* q = coeffs + giant;
+    size_t q_count = count - giant;
+    if (degree_of(q, q_count) == 0) {
+      multiply_const(x_giant, q[0], chain_index + 1, upper_scale, result);
+    } else {
+      Ciphertext q_value, giant_value;
+      evaluate_range(powers, q, q_count, chain_index + 1, upper_scale / x_giant.scale(), q_value);
+      evaluator_.mod_switch_to(x_giant, parms_ids_[chain_index + 1], giant_value);
+      evaluator_.multiply(q_value, giant_value, result);
+      evaluator_.relinearize_inplace(result, relin_keys_);
+      result.scale() = upper_scale;
+    }
+
+    if (degree_of(coeffs, giant) > 0) {
+      Ciphertext r_value;
+      evaluate_range(powers, coeffs, giant, chain_index, scale, r_value);
+      evaluator_.rescale_to_next_inplace(result);
+      result.scale() = scale;
+      evaluator_.add_inplace(result, r_value);
+      return;
+    }
+  }
+
+  evaluator_.rescale_to_next_inplace(result);
+  result.scale() = scale; // upper_scale / q only differs from scale by floating-point rounding
+  if (coeffs[0] != 0) {
+    evaluator_.add_plain_inplace(result, *encode(coeffs[0], result.parms_id(), scale));
+  }
+}
+
+void evalPlainPolynomial(soa_cx_vector& res, soa_cx_vector const& in, std::vector<double> const& coeffs) {
+  size_t len = in.size();
+  res.resize(len);
+  double const *a_re = in.re.data(), *a_im = in.im.data();
+  double *r_re = res.re.data(), *r_im = res.im.data();
+  double const *c = coeffs.data();
+  size_t degree_plus_one = coeffs.size();
+  // Each slot runs the whole Horner recurrence in registers and is written once, so res may alias in
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    double re = 0, im = 0;
+    for (size_t j = degree_plus_one; j-- > 0;) {
+      double next_re = re * a_re[i] - im * a_im[i] + c[j];
+      im = re * a_im[i] + im * a_re[i];
+      re = next_re;
+    }
+    r_re[i] = re;
+    r_im[i] = im;
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "plaintext_cache.h"
+#include "trace.h"
+
+/// Baby-step/giant-step (Paterson-Stockmeyer style) schedule for evaluating one polynomial.
+/// The polynomial is split recursively as p = q * x^(k*2^j) + r until the pieces have degree < k,
+/// which are then evaluated as linear combinations of the baby steps x^1 .. x^(k-1).
+struct PolyEvalPlan {
+  std::size_t degree = 0;           ///< degree of the polynomial (after dropping leading zeros)
+  std::size_t baby_step = 0;        ///< k, a power of two
+  std::size_t giant_steps = 0;      ///< number of giant powers x^k, x^2k, x^4k, ...
+  std::size_t depth = 0;            ///< multiplicative depth, i.e. number of levels consumed
+  std::size_t nonscalar_mults = 0;  ///< ciphertext-ciphertext multiplications (each one also relinearizes)
+
+  /// Pick the baby step that needs the fewest non-scalar multiplications within the depth budget
+  /// \param coeffs coeffs[i] is the coefficient of x^i; zero coefficients are skipped
+  /// \param depth_budget Largest acceptable depth; anything below the minimum depth (e.g. 0) selects the minimum depth
+  static PolyEvalPlan Create(std::vector<double> const &coeffs, std::size_t depth_budget = 0);
+};
+
+/// Evaluates polynomials on CKKS ciphertexts, taking care of relinearization, rescaling and mod-switching.
+/// The plaintext constants are encoded at exactly the scale that makes all terms meet at the same level and scale,
+/// so the result has the same scale as the input and no manual scale overrides are necessary.
+class PolynomialEvaluator {
+ public:
+  /// \param cache If given, coefficients are taken from (and added to) this cache instead of encoded on every call
+  PolynomialEvaluator(seal::SEALContext const &context, seal::Evaluator const &evaluator,
+                      seal::CKKSEncoder const &encoder, seal::RelinKeys const &relin_keys,
+                      PlaintextCache *cache = nullptr);
+
+  /// Compute result = sum_i coeffs[i] * x^i
+  /// \param x Input ciphertext, must have at least PolyEvalPlan::Create(coeffs, depth_budget).depth levels left
+  /// \param coeffs coeffs[i] is the coefficient of x^i, the degree must be at least 1
+  /// \param result Ciphertext to store result in, at the same scale as x
+  /// \param depth_budget Levels the evaluation may consume, see PolyEvalPlan::Create
+  /// \throws std::invalid_argument if the polynomial is constant, x does not have enough levels left, or a coefficient
+  /// would have to be encoded at a scale below 1 (the primes are too small for the scale of x)
+  void evaluate(seal::Ciphertext const &x, std::vector<double> const &coeffs, seal::Ciphertext &result,
+                std::size_t depth_budget = 0) const;
+
+ private:
+  struct Powers;
+
+  seal::Ciphertext const &power(Powers &powers, std::size_t i) const;
+
+  void evaluate_range(Powers &powers, double const *coeffs, std::size_t count, std::size_t chain_index,
+                      double scale, seal::Ciphertext &result) const;
+
+  std::shared_ptr<seal::Plaintext const> encode(double value, seal::parms_id_type const &parms_id,
+                                                double scale) const;
+
+  void multiply_const(seal::Ciphertext const &a, double value, std::size_t chain_index, double scale,
+                      seal::Ciphertext &result) const;
+
+  seal::SEALContext const &context_;
+  seal::Evaluator const &evaluator_;
+  seal::CKKSEncoder const &encoder_;
+  seal::RelinKeys const &relin_keys_;
+  PlaintextCache *cache_;
+  std::vector<seal::parms_id_type> parms_ids_; // indexed by chain index
+};
+
+/// Plaintext reference for PolynomialEvaluator: res = sum_i coeffs[i] * in^i (slot-wise, by Horner's rule).
+/// res may alias in.
+void evalPlainPolynomial(soa_cx_vector &res, soa_cx_vector const &in, std::vector<double> const &coeffs);
@@ -0,0 +1,281 @@
+#include "baseline.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    const string header = "sealbench-baseline 1";
+
+    /*
+    Samples of one baseline file, keyed by (threads, operation). Each line of the file holds
+    <threads> <operation> <count> <sample>...
+    */
+    using BaselineEntries = map<pair<size_t, string>, vector<double>>;
+
+    string baseline_path(const string &dir, const string &host, const BenchmarkResult &result, bool pinned = false)
+    {
+        string bits;
+        for (auto b : result.coeff_modulus_bits)
+        {
+            bits += (bits.empty() ? "" : "-") + to_string(b);
+        }
+        return dir + "/" + host + "_" + result.scheme + "_" + to_string(result.poly_modulus_degree) + "_" + bits +
+               (pinned ? ".pinned.txt" : ".txt");
+    }
+
+    /*
+    A missing file has no entries.
+    */
+    BaselineEntries load(const string &path)
+    {
+        BaselineEntries entries;
+        ifstream in(path);
+        if (!in)
+        {
+            return entries;
+        }
+        string line;
+        if (!getline(in, line) || line != header)
+        {
+            throw runtime_error(path + " is not a sealbench baseline");
+        }
+        while (getline(in, line))
+        {
+            istringstream ss(line);
+            size_t threads = 0;
+            size_t count = 0;
+            string operation;
+            if (!(ss >> threads >> operation >> count))
+            {
+                throw runtime_error("malformed line in " + path);
+            }
+            vector<double> samples(count);
+            for (auto &sample : samples)
+            {
+                if (!(ss >> sample))
+                {
+                    throw runtime_error("malformed line in " + path);
+                }
+            }
+            entries[{ threads, operation }] = move(samples);
+        }
+        return entries;
+    }
+
+    /*
+    Writes a temporary file first and renames it, so an interrupted run never leaves a truncated baseline.
+    */
+    void store(const string &path, const BaselineEntries &entries)
+    {
+        string tmp_path = path + ".tmp";
+        {
+            ofstream out(tmp_path);
+            out << header << '\n' << setprecision(9);
+            for (auto &entry : entries)
+            {
+                out << entry.first.first << ' ' << entry.first.second << ' ' << entry.second.size();
+                for (auto sample : entry.second)
+                {
+                    out << ' ' << sample;
+                }
+                out << '\n';
+            }
+            if (!out)
+            {
+                throw runtime_error("cannot write " + tmp_path);
+            }
+        }
+        if (rename(tmp_path.c_str(), path.c_str()) != 0)
+        {
+            throw runtime_error("cannot replace " + path);
+        }
+    }
+
+    double median(const vector<double> &samples)
+    {
+        return summarize(samples).median;
+    }
+
+    /*
+    Baseline files loaded on first use, so every file is read once however many results it holds
+    */
+    class BaselineFiles
+    {
+    public:
+        BaselineEntries &get(const string &path)
+        {
+            auto file = files_.find(path);
+            if (file == files_.end())
+            {
+                file = files_.emplace(path, load(path)).first;
+            }
+            return file->second;
+        }
+
+        const vector<double> *find(const string &path, const BenchmarkResult &result)
+        {
+            auto &entries = get(path);
+            auto entry = entries.find({ result.threads, result.operation });
+            return entry == entries.end() || entry->second.empty() ? nullptr : &entry->second;
+        }
+
+        void store_all() const
+        {
+            for (auto &file : files_)
+            {
+                store(file.first, file.second);
+            }
+        }
+
+    private:
+        map<string, BaselineEntries> files_;
+    };
+
+    BenchmarkComparison compare(
+        const BenchmarkResult &result, const vector<double> &baseline, const string &kind, double threshold,
+        double alpha)
+    {
+        BenchmarkComparison comparison;
+        comparison.scheme = result.scheme;
+        comparison.poly_modulus_degree = result.poly_modulus_degree;
+        comparison.threads = result.threads;
+        comparison.operation = result.operation;
+        comparison.baseline = kind;
+        comparison.baseline_median = median(baseline);
+        comparison.median = result.stats.median;
+        comparison.change = comparison.median / comparison.baseline_median - 1;
+        comparison.p_value = mann_whitney_p_value(result.samples, baseline);
+        bool significant = comparison.p_value < alpha;
+        comparison.regression = significant && comparison.change > threshold;
+        comparison.improvement = significant && comparison.change < -threshold;
+        return comparison;
+    }
+} // namespace
+
+string benchmark_host()
+{
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) != 0 || !name[0])
+    {
+        return "unknown";
+    }
+    string host(name);
+    for (auto &c : host)
+    {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '.')
+        {
+            c = '_';
+        }
+    }
+    return host;
+}
+
+double mann_whitney_p_value(const vector<double> &a, const vector<double> &b)
+{
+    if (a.empty() || b.empty())
+    {
+        return 1;
+    }
+
+    // Rank the pooled samples; tied values share the average of their ranks
+    vector<pair<double, bool>> pooled;
+    for (auto x : a)
+    {
+        pooled.emplace_back(x, true);
+    }
+    for (auto x : b)
+    {
+        pooled.emplace_back(x, false);
+    }
+    sort(pooled.begin(), pooled.end());
+
+    double n1 = static_cast<double>(a.size());
+    double n2 = static_cast<double>(b.size());
+    double n = n1 + n2;
+    double rank_sum_a = 0;
+    double tie_term = 0;
+    for (size_t i = 0; i < pooled.size();)
+    {
+        size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first)
+        {
+            j++;
+        }
+        double rank = static_cast<double>(i + 1 + j) / 2;
+        for (size_t k = i; k < j; k++)
+        {
+            if (pooled[k].second)
+            {
+                rank_sum_a += rank;
+            }
+        }
+        double t = static_cast<double>(j - i);
+        tie_term += t * t * t - t;
+        i = j;
+    }
+
+    double u = rank_sum_a - n1 * (n1 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)));
+    if (variance <= 0)
+    {
+        // Every sample has the same value
+        return 1;
+    }
+    double z = max(fabs(u - mean) - 0.5, 0.0) / sqrt(variance);
+    return erfc(z / sqrt(2.0));
+}
+
+void save_baseline(const string &dir, const string &host, const vector<BenchmarkResult> &results, bool update_pinned)
+{
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw runtime_error("cannot create baseline directory " + dir);
+    }
+
+    BaselineFiles files;
+    for (auto &result : results)
+    {
+        files.get(baseline_path(dir, host, result))[{ result.threads, result.operation }] = result.samples;
+        string pinned_path = baseline_path(dir, host, result, true);
+        if (update_pinned || !files.find(pinned_path, result))
+        {
+            files.get(pinned_path)[{ result.threads, result.operation }] = result.samples;
+        }
+    }
+    files.store_all();
+}
+
+vector<BenchmarkComparison> compare_to_baseline(
+    const string &dir, const string &host, const vector<BenchmarkResult> &results, double threshold, double alpha)
+{
+    vector<BenchmarkComparison> comparisons;
+    BaselineFiles files;
+    for (auto &result : results)
+    {
+        auto last = files.find(baseline_path(dir, host, result), result);
+        auto pinned = files.find(baseline_path(dir, host, result, true), result);
+        if (last)
+        {
+            comparisons.push_back(compare(result, *last, "last", threshold, alpha));
+        }
+        if (pinned && (!last || *pinned != *last))
+        {
+            comparisons.push_back(compare(result, *pinned, "pinned", threshold, alpha));
+        }
+    }
+    return comparisons;
+}
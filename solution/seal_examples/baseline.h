@@ -0,0 +1,48 @@
+#pragma once
+
+#include "benchmark.h"
+#include <string>
+#include <vector>
+
+/*
+Local store of benchmark baselines. A baseline directory holds one file per host and parameter set, named
+<host>_<scheme>_<poly_modulus_degree>_<coeff_modulus_bits>.txt, with the raw samples of every thread count and
+operation measured for it. Raw samples are kept (not only the summary) so a later run can be compared with a
+rank test rather than by eyeballing means.
+
+Each of these files holds the last saved run. Next to it, <...>.pinned.txt holds the pinned baseline: the first
+saved run of every entry, replaced only on request. Comparing against both catches a sudden slowdown as well as a
+series of small ones, each below the threshold, that would otherwise move the last run down step by step.
+*/
+
+/*
+Name of this machine as used in baseline file names (gethostname, with characters other than letters,
+digits, '-' and '.' replaced by '_').
+*/
+std::string benchmark_host();
+
+/*
+Two-sided p-value of the Mann-Whitney U test that a and b come from the same distribution, using the normal
+approximation with tie and continuity correction (accurate for the 20+ samples per side a benchmark yields).
+Returns 1 if either side is empty.
+*/
+double mann_whitney_p_value(const std::vector<double> &a, const std::vector<double> &b);
+
+/*
+Stores the samples of results as the last run of host, replacing the entries of the same thread count and
+operation and keeping the others. Entries without a pinned baseline are pinned as well; with update_pinned,
+every pinned entry of results is replaced. Creates dir if it does not exist.
+*/
+void save_baseline(
+    const std::string &dir, const std::string &host, const std::vector<BenchmarkResult> &results,
+    bool update_pinned = false);
+
+/*
+Compares every result that has a stored baseline of host, against the last run and, where it differs from that,
+against the pinned baseline (one comparison each). A result is a regression if its median is more than threshold
+(e.g. 0.05 for 5%) above the baseline median and the samples differ at significance level alpha; an improvement
+likewise in the other direction.
+*/
+std::vector<BenchmarkComparison> compare_to_baseline(
+    const std::string &dir, const std::string &host, const std::vector<BenchmarkResult> &results, double threshold,
+    double alpha);
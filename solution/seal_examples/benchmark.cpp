@@ -0,0 +1,860 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+using namespace seal;
+
+BenchmarkStatistics summarize(vector<double> samples)
+{
+    BenchmarkStatistics stats;
+    stats.count = samples.size();
+    if (samples.empty())
+    {
+        return stats;
+    }
+    sort(samples.begin(), samples.end());
+
+    size_t n = samples.size();
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    stats.p99 = samples[static_cast<size_t>(ceil(0.99 * static_cast<double>(n))) - 1];
+
+    double sum = 0;
+    for (auto sample : samples)
+    {
+        sum += sample;
+    }
+    stats.mean = sum / static_cast<double>(n);
+    if (n > 1)
+    {
+        double squares = 0;
+        for (auto sample : samples)
+        {
+            squares += (sample - stats.mean) * (sample - stats.mean);
+        }
+        stats.stddev = sqrt(squares / static_cast<double>(n - 1));
+    }
+    return stats;
+}
+
+namespace
+{
+    template <typename F>
+    double time_us(F &&f)
+    {
+        auto start = chrono::steady_clock::now();
+        f();
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    }
+
+    /*
+    Parameters and keys shared by all threads of one parameter set. The coefficient modulus is BFVDefault for
+    both schemes, as in 7_performance.cpp.
+    */
+    struct KeySet
+    {
+        KeySet(scheme_type scheme, size_t poly_modulus_degree) : context(create_parameters(scheme, poly_modulus_degree))
+        {
+            if (!context.parameters_set())
+            {
+                throw invalid_argument(
+                    "invalid parameters for poly_modulus_degree " + to_string(poly_modulus_degree) + ": " +
+                    context.parameter_error_message());
+            }
+            KeyGenerator keygen(context);
+            secret_key = keygen.secret_key();
+            keygen.create_public_key(public_key);
+            if (context.using_keyswitching())
+            {
+                keygen.create_relin_keys(relin_keys);
+                keygen.create_galois_keys(galois_keys);
+            }
+        }
+
+        static EncryptionParameters create_parameters(scheme_type scheme, size_t poly_modulus_degree)
+        {
+            EncryptionParameters parms(scheme);
+            parms.set_poly_modulus_degree(poly_modulus_degree);
+            parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree));
+            if (scheme == scheme_type::bfv)
+            {
+                parms.set_plain_modulus(poly_modulus_degree == 1024 ? 12289 : 786433);
+            }
+            return parms;
+        }
+
+        SEALContext context;
+        SecretKey secret_key;
+        PublicKey public_key;
+        RelinKeys relin_keys;
+        GaloisKeys galois_keys;
+    };
+
+    /*
+    Everything one thread needs to run the operations: its own encoder, encryptor, decryptor and evaluator, and
+    its own inputs. Each operation copies its inputs outside the timed region, so calls are independent.
+    */
+    class Worker
+    {
+    public:
+        Worker(const KeySet &keys, uint64_t seed)
+            : keys_(keys), encryptor_(keys.context, keys.public_key), decryptor_(keys.context, keys.secret_key),
+              evaluator_(keys.context), rng_(seed)
+        {
+            auto &parms = keys.context.first_context_data()->parms();
+            if (parms.scheme() == scheme_type::ckks)
+            {
+                ckks_encoder_.reset(new CKKSEncoder(keys.context));
+                slot_count_ = ckks_encoder_->slot_count();
+                uniform_real_distribution<double> dist(-1.0, 1.0);
+                for (size_t i = 0; i < slot_count_; i++)
+                {
+                    real_values_.push_back(dist(rng_));
+                }
+                // As in 7_performance.cpp: the product of two fresh ciphertexts still fits the next level
+                scale_ = sqrt(static_cast<double>(parms.coeff_modulus().back().value()));
+            }
+            else
+            {
+                batch_encoder_.reset(new BatchEncoder(keys.context));
+                slot_count_ = batch_encoder_->slot_count();
+                for (size_t i = 0; i < slot_count_; i++)
+                {
+                    int_values_.push_back(parms.plain_modulus().reduce(rng_()));
+                }
+            }
+
+            encode(plain_);
+            encryptor_.encrypt(plain_, encrypted1_);
+            encryptor_.encrypt(plain_, encrypted2_);
+            if (keys.context.using_keyswitching())
+            {
+                evaluator_.multiply(encrypted1_, encrypted2_, product_);
+                evaluator_.relinearize(product_, keys.relin_keys, relinearized_);
+            }
+        }
+
+        double encode()
+        {
+            Plaintext plain;
+            return time_us([&] { encode(plain); });
+        }
+
+        double decode()
+        {
+            if (ckks_encoder_)
+            {
+                vector<double> values;
+                return time_us([&] { ckks_encoder_->decode(plain_, values); });
+            }
+            vector<uint64_t> values;
+            return time_us([&] { batch_encoder_->decode(plain_, values); });
+        }
+
+        double encrypt()
+        {
+            Ciphertext encrypted(keys_.context);
+            return time_us([&] { encryptor_.encrypt(plain_, encrypted); });
+        }
+
+        double decrypt()
+        {
+            Plaintext plain;
+            return time_us([&] { decryptor_.decrypt(encrypted1_, plain); });
+        }
+
+        double add()
+        {
+            Ciphertext encrypted = encrypted1_;
+            return time_us([&] { evaluator_.add_inplace(encrypted, encrypted2_); });
+        }
+
+        double multiply()
+        {
+            Ciphertext encrypted = encrypted1_;
+            encrypted.reserve(3);
+            return time_us([&] { evaluator_.multiply_inplace(encrypted, encrypted2_); });
+        }
+
+        double multiply_plain()
+        {
+            Ciphertext encrypted = encrypted1_;
+            return time_us([&] { evaluator_.multiply_plain_inplace(encrypted, plain_); });
+        }
+
+        double square()
+        {
+            Ciphertext encrypted = encrypted1_;
+            encrypted.reserve(3);
+            return time_us([&] { evaluator_.square_inplace(encrypted); });
+        }
+
+        double relinearize()
+        {
+            Ciphertext encrypted = product_;
+            return time_us([&] { evaluator_.relinearize_inplace(encrypted, keys_.relin_keys); });
+        }
+
+        double multiply_relinearize()
+        {
+            Ciphertext encrypted = encrypted1_;
+            encrypted.reserve(3);
+            return time_us([&] {
+                evaluator_.multiply_inplace(encrypted, encrypted2_);
+                evaluator_.relinearize_inplace(encrypted, keys_.relin_keys);
+            });
+        }
+
+        double rescale()
+        {
+            Ciphertext encrypted = relinearized_;
+            return time_us([&] { evaluator_.rescale_to_next_inplace(encrypted); });
+        }
+
+        double rotate_one_step()
+        {
+            Ciphertext encrypted = encrypted1_;
+            if (ckks_encoder_)
+            {
+                return time_us([&] { evaluator_.rotate_vector_inplace(encrypted, 1, keys_.galois_keys); });
+            }
+            return time_us([&] { evaluator_.rotate_rows_inplace(encrypted, 1, keys_.galois_keys); });
+        }
+
+        double rotate_random()
+        {
+            Ciphertext encrypted = encrypted1_;
+            // The number of CKKS slots and of BFV row entries are powers of two
+            if (ckks_encoder_)
+            {
+                int steps = static_cast<int>(rng_() & (slot_count_ - 1));
+                return time_us([&] { evaluator_.rotate_vector_inplace(encrypted, steps, keys_.galois_keys); });
+            }
+            int steps = static_cast<int>(rng_() & (slot_count_ / 2 - 1));
+            return time_us([&] { evaluator_.rotate_rows_inplace(encrypted, steps, keys_.galois_keys); });
+        }
+
+        double rotate_columns()
+        {
+            Ciphertext encrypted = encrypted1_;
+            return time_us([&] { evaluator_.rotate_columns_inplace(encrypted, keys_.galois_keys); });
+        }
+
+        double conjugate()
+        {
+            Ciphertext encrypted = encrypted1_;
+            return time_us([&] { evaluator_.complex_conjugate_inplace(encrypted, keys_.galois_keys); });
+        }
+
+        double serialize()
+        {
+            vector<seal_byte> buffer(static_cast<size_t>(encrypted1_.save_size(compr_mode_type::none)));
+            return time_us([&] { encrypted1_.save(buffer.data(), buffer.size(), compr_mode_type::none); });
+        }
+
+    private:
+        void encode(Plaintext &plain)
+        {
+            if (ckks_encoder_)
+            {
+                ckks_encoder_->encode(real_values_, scale_, plain);
+            }
+            else
+            {
+                batch_encoder_->encode(int_values_, plain);
+            }
+        }
+
+        const KeySet &keys_;
+        Encryptor encryptor_;
+        Decryptor decryptor_;
+        Evaluator evaluator_;
+        unique_ptr<CKKSEncoder> ckks_encoder_;
+        unique_ptr<BatchEncoder> batch_encoder_;
+        mt19937_64 rng_;
+        size_t slot_count_ = 0;
+        vector<double> real_values_;
+        vector<uint64_t> int_values_;
+        double scale_ = 1.0;
+        Plaintext plain_;
+        Ciphertext encrypted1_;
+        Ciphertext encrypted2_;
+        Ciphertext product_;
+        Ciphertext relinearized_;
+    };
+
+    struct Operation
+    {
+        const char *name;
+        bool ckks;
+        bool bfv;
+        bool keyswitching;
+        double (Worker::*run)();
+    };
+
+    const Operation operations[] = {
+        { "encode", true, true, false, &Worker::encode },
+        { "decode", true, true, false, &Worker::decode },
+        { "encrypt", true, true, false, &Worker::encrypt },
+        { "decrypt", true, true, false, &Worker::decrypt },
+        { "add", true, true, false, &Worker::add },
+        { "multiply", true, true, false, &Worker::multiply },
+        { "multiply_plain", true, true, false, &Worker::multiply_plain },
+        { "square", true, true, false, &Worker::square },
+        { "relinearize", true, true, true, &Worker::relinearize },
+        { "multiply_relinearize", true, true, true, &Worker::multiply_relinearize },
+        { "rescale", true, false, true, &Worker::rescale },
+        { "rotate_one_step", true, true, true, &Worker::rotate_one_step },
+        { "rotate_random", true, true, true, &Worker::rotate_random },
+        { "rotate_columns", false, true, true, &Worker::rotate_columns },
+        { "conjugate", true, false, true, &Worker::conjugate },
+        { "serialize", true, true, false, &Worker::serialize },
+    };
+
+    bool supports(const Operation &op, scheme_type scheme)
+    {
+        return scheme == scheme_type::ckks ? op.ckks : op.bfv;
+    }
+
+    string scheme_name(scheme_type scheme)
+    {
+        return scheme == scheme_type::ckks ? "ckks" : "bfv";
+    }
+
+    /*
+    Resident set size and its peak since the last reset_peak_rss(), in bytes, from /proc/self/status. Both are 0
+    where that file does not exist.
+    */
+    void read_rss(size_t &rss, size_t &peak_rss)
+    {
+        rss = 0;
+        peak_rss = 0;
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line))
+        {
+            // Lines look like "VmRSS:     123456 kB"
+            if (line.compare(0, 6, "VmRSS:") == 0)
+            {
+                rss = static_cast<size_t>(stoull(line.substr(6))) * 1024;
+            }
+            else if (line.compare(0, 6, "VmHWM:") == 0)
+            {
+                peak_rss = static_cast<size_t>(stoull(line.substr(6))) * 1024;
+            }
+        }
+    }
+
+    /*
+    Linux resets the peak resident set size (VmHWM) to the current one when 5 is written to clear_refs. Returns
+    false if that write failed (no such file, or not permitted).
+    */
+    bool reset_peak_rss()
+    {
+        ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+        clear_refs.close();
+        return !clear_refs.fail();
+    }
+
+    /*
+    Runs warmup + iterations calls of op on every worker at once, one thread per worker, and fills in the
+    samples, throughput and memory use of result. Throughput only counts the timed calls: each thread
+    contributes its call count over the sum of its samples.
+    */
+    void measure(
+        vector<unique_ptr<Worker>> &workers, const Operation &op, size_t warmup, size_t iterations,
+        bool thread_local_pool, BenchmarkResult &result)
+    {
+        size_t thread_count = workers.size();
+        vector<vector<double>> samples(thread_count);
+        vector<exception_ptr> errors(thread_count);
+        vector<size_t> pool_before(thread_count), pool_after(thread_count);
+        atomic<size_t> ready(0);
+
+        size_t rss_before = 0, peak_rss = 0;
+        bool peak_reset = reset_peak_rss();
+        read_rss(rss_before, peak_rss);
+        size_t global_pool_before = MemoryManager::GetPool().alloc_byte_count();
+
+        vector<thread> threads;
+        for (size_t t = 0; t < thread_count; t++)
+        {
+            threads.emplace_back([&, t] {
+                try
+                {
+                    Worker &worker = *workers[t];
+                    samples[t].reserve(iterations);
+                    pool_before[t] = MemoryManager::GetPool().alloc_byte_count();
+                    for (size_t i = 0; i < warmup; i++)
+                    {
+                        (worker.*op.run)();
+                    }
+
+                    // Start the timed calls together, so every sample is taken under the full load
+                    ready++;
+                    while (ready.load() < thread_count)
+                    {
+                        this_thread::yield();
+                    }
+                    for (size_t i = 0; i < iterations; i++)
+                    {
+                        samples[t].push_back((worker.*op.run)());
+                    }
+                    pool_after[t] = MemoryManager::GetPool().alloc_byte_count();
+                }
+                catch (...)
+                {
+                    errors[t] = current_exception();
+                    ready++;
+                }
+            });
+        }
+        for (auto &th : threads)
+        {
+            th.join();
+        }
+        for (auto &error : errors)
+        {
+            if (error)
+            {
+                rethrow_exception(error);
+            }
+        }
+
+        result.ops_per_second = 0;
+        for (auto &s : samples)
+        {
+            double busy_us = accumulate(s.begin(), s.end(), 0.0);
+            if (busy_us > 0)
+            {
+                result.ops_per_second += static_cast<double>(s.size()) * 1e6 / busy_us;
+            }
+            result.samples.insert(result.samples.end(), s.begin(), s.end());
+        }
+
+        // Every thread sees its own pool with MMProfThreadLocal, and the global pool otherwise
+        if (thread_local_pool)
+        {
+            result.pool_bytes_before = accumulate(pool_before.begin(), pool_before.end(), size_t(0));
+            result.pool_bytes_after = accumulate(pool_after.begin(), pool_after.end(), size_t(0));
+        }
+        else
+        {
+            result.pool_bytes_before = global_pool_before;
+            result.pool_bytes_after = MemoryManager::GetPool().alloc_byte_count();
+        }
+
+        size_t rss_after = 0;
+        read_rss(rss_after, peak_rss);
+        result.peak_rss_available = peak_reset && peak_rss > 0;
+        result.peak_rss_delta = result.peak_rss_available && peak_rss > rss_before ? peak_rss - rss_before : 0;
+    }
+
+    /*
+    Key sizes are their uncompressed serialized sizes, which match their in-memory data. Ciphertexts are
+    measured after encrypting at the first data level and mod switching down the chain.
+    */
+    BenchmarkFootprint footprint(const KeySet &keys)
+    {
+        BenchmarkFootprint result;
+        auto &parms = keys.context.key_context_data()->parms();
+        result.scheme = scheme_name(parms.scheme());
+        result.poly_modulus_degree = parms.poly_modulus_degree();
+        for (auto &modulus : parms.coeff_modulus())
+        {
+            result.coeff_modulus_bits.push_back(modulus.bit_count());
+        }
+        result.secret_key_bytes = static_cast<size_t>(keys.secret_key.save_size(compr_mode_type::none));
+        result.public_key_bytes = static_cast<size_t>(keys.public_key.save_size(compr_mode_type::none));
+        if (keys.context.using_keyswitching())
+        {
+            result.relin_keys_bytes = static_cast<size_t>(keys.relin_keys.save_size(compr_mode_type::none));
+            result.galois_keys_bytes = static_cast<size_t>(keys.galois_keys.save_size(compr_mode_type::none));
+        }
+
+        Encryptor encryptor(keys.context, keys.public_key);
+        Evaluator evaluator(keys.context);
+        Ciphertext encrypted;
+        encryptor.encrypt_zero(encrypted);
+        result.ciphertext_bytes.resize(keys.context.first_context_data()->chain_index() + 1);
+        while (true)
+        {
+            size_t chain_index = keys.context.get_context_data(encrypted.parms_id())->chain_index();
+            result.ciphertext_bytes[chain_index] = encrypted.size() * encrypted.poly_modulus_degree() *
+                                                   encrypted.coeff_modulus_size() * sizeof(uint64_t);
+            if (chain_index == 0)
+            {
+                break;
+            }
+            evaluator.mod_switch_to_next_inplace(encrypted);
+        }
+        return result;
+    }
+} // namespace
+
+vector<string> benchmark_operations(scheme_type scheme)
+{
+    vector<string> names;
+    for (auto &op : operations)
+    {
+        if (supports(op, scheme))
+        {
+            names.push_back(op.name);
+        }
+    }
+    return names;
+}
+
+vector<string> scaling_operations()
+{
+    return { "encode", "encrypt", "multiply_relinearize", "rescale", "rotate_one_step", "decrypt", "decode" };
+}
+
+vector<size_t> scaling_thread_counts(size_t max_threads)
+{
+    vector<size_t> counts;
+    for (size_t t = 1; t < max_threads; t *= 2)
+    {
+        counts.push_back(t);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+void run_benchmarks(const BenchmarkOptions &options, BenchmarkReport &report, ostream *progress)
+{
+    if (options.thread_local_pool)
+    {
+        MemoryManager::SwitchProfile(make_unique<MMProfThreadLocal>());
+    }
+
+    for (auto scheme : options.schemes)
+    {
+        vector<const Operation *> selected;
+        for (auto &op : operations)
+        {
+            if (supports(op, scheme) && (options.operations.empty() || find(options.operations.begin(),
+                                                                            options.operations.end(),
+                                                                            op.name) != options.operations.end()))
+            {
+                selected.push_back(&op);
+            }
+        }
+
+        for (auto degree : options.degrees)
+        {
+            if (progress)
+            {
+                *progress << scheme_name(scheme) << " " << degree << ": generating keys" << endl;
+            }
+            KeySet keys(scheme, degree);
+            bool keyswitching = keys.context.using_keyswitching();
+            bool rescaling = keys.context.first_context_data()->next_context_data() != nullptr;
+            if (options.memory)
+            {
+                report.footprints.push_back(footprint(keys));
+            }
+
+            vector<int> bits;
+            for (auto &modulus : keys.context.key_context_data()->parms().coeff_modulus())
+            {
+                bits.push_back(modulus.bit_count());
+            }
+
+            // Single-thread throughput of each operation is the reference for scaling_efficiency, so one thread
+            // runs first, whether or not it was asked for
+            bool report_single_thread =
+                find(options.threads.begin(), options.threads.end(), size_t(1)) != options.threads.end();
+            vector<size_t> thread_counts = { 1 };
+            for (auto thread_count : options.threads)
+            {
+                if (thread_count != 1)
+                {
+                    thread_counts.push_back(thread_count);
+                }
+            }
+            map<string, double> single_thread;
+            for (auto thread_count : thread_counts)
+            {
+                vector<unique_ptr<Worker>> workers;
+                for (size_t t = 0; t < thread_count; t++)
+                {
+                    workers.emplace_back(new Worker(keys, t + 1));
+                }
+
+                for (auto op : selected)
+                {
+                    if ((op->keyswitching && !keyswitching) || (op->run == &Worker::rescale && !rescaling))
+                    {
+                        continue;
+                    }
+                    if (progress)
+                    {
+                        *progress << scheme_name(scheme) << " " << degree << " x" << thread_count << ": " << op->name
+                                  << endl;
+                    }
+
+                    BenchmarkResult result;
+                    result.scheme = scheme_name(scheme);
+                    result.poly_modulus_degree = degree;
+                    result.coeff_modulus_bits = bits;
+                    result.threads = thread_count;
+                    result.operation = op->name;
+                    measure(workers, *op, options.warmup, options.iterations, options.thread_local_pool, result);
+                    result.stats = summarize(result.samples);
+                    if (thread_count == 1)
+                    {
+                        single_thread[op->name] = result.ops_per_second;
+                    }
+                    if (single_thread[op->name] > 0)
+                    {
+                        result.scaling_efficiency = result.ops_per_second /
+                                                    (static_cast<double>(thread_count) * single_thread[op->name]);
+                    }
+                    if (thread_count != 1 || report_single_thread)
+                    {
+                        report.results.push_back(move(result));
+                    }
+                }
+            }
+        }
+    }
+}
+
+namespace
+{
+    string join_bits(const vector<int> &bits, char separator)
+    {
+        string joined;
+        for (size_t i = 0; i < bits.size(); i++)
+        {
+            joined += (i ? string(1, separator) : string()) + to_string(bits[i]);
+        }
+        return joined;
+    }
+} // namespace
+
+void write_report_text(ostream &os, const BenchmarkReport &report)
+{
+    ios old_fmt(nullptr);
+    old_fmt.copyfmt(os);
+    os << left << setw(8) << "scheme" << setw(8) << "N" << setw(8) << "threads" << setw(22) << "operation" << right
+       << setw(12) << "median us" << setw(12) << "mean us" << setw(12) << "stddev us" << setw(12) << "p99 us"
+       << setw(12) << "ops/s" << setw(12) << "efficiency" << setw(12) << "pool KiB" << setw(14) << "peak RSS KiB"
+       << endl;
+    os << fixed << setprecision(1);
+    for (auto &r : report.results)
+    {
+        os << left << setw(8) << r.scheme << setw(8) << r.poly_modulus_degree << setw(8) << r.threads << setw(22)
+           << r.operation << right << setw(12) << r.stats.median << setw(12) << r.stats.mean << setw(12)
+           << r.stats.stddev << setw(12) << r.stats.p99 << setw(12) << r.ops_per_second;
+        if (r.scaling_efficiency > 0)
+        {
+            os << setw(12) << setprecision(3) << r.scaling_efficiency << setprecision(1);
+        }
+        else
+        {
+            os << setw(12) << "-";
+        }
+        os << setw(12) << r.pool_bytes_after / 1024;
+        if (r.peak_rss_available)
+        {
+            os << setw(14) << r.peak_rss_delta / 1024 << endl;
+        }
+        else
+        {
+            os << setw(14) << "-" << endl;
+        }
+    }
+
+    if (!report.footprints.empty())
+    {
+        os << endl
+           << left << setw(8) << "scheme" << setw(8) << "N" << right << setw(14) << "public KiB" << setw(14)
+           << "relin KiB" << setw(14) << "galois KiB"
+           << "  ciphertext KiB by level (top first)" << endl;
+        for (auto &f : report.footprints)
+        {
+            os << left << setw(8) << f.scheme << setw(8) << f.poly_modulus_degree << right << setw(14)
+               << f.public_key_bytes / 1024 << setw(14) << f.relin_keys_bytes / 1024 << setw(14)
+               << f.galois_keys_bytes / 1024 << " ";
+            for (auto it = f.ciphertext_bytes.rbegin(); it != f.ciphertext_bytes.rend(); ++it)
+            {
+                os << " " << *it / 1024;
+            }
+            os << endl;
+        }
+    }
+
+    if (!report.comparisons.empty())
+    {
+        os << endl
+           << left << setw(8) << "scheme" << setw(8) << "N" << setw(8) << "threads" << setw(22) << "operation"
+           << setw(10) << "baseline" << right << setw(14) << "baseline us" << setw(12) << "median us" << setw(10) << "change" << setw(12) << "p-value"
+           << endl;
+        for (auto &c : report.comparisons)
+        {
+            os << left << setw(8) << c.scheme << setw(8) << c.poly_modulus_degree << setw(8) << c.threads << setw(22)
+               << c.operation << setw(10) << c.baseline << right << setprecision(1) << setw(14) << c.baseline_median << setw(12) << c.median
+               << setw(9) << showpos << 100 * c.change << "%" << noshowpos << setprecision(4) << setw(12)
+               << c.p_value << (c.regression ? "  REGRESSION" : c.improvement ? "  improved" : "") << endl;
+        }
+    }
+    os.copyfmt(old_fmt);
+}
+
+namespace
+{
+    template <typename T>
+    void write_json_array(ostream &os, const vector<T> &values)
+    {
+        os << "[";
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            os << (i ? "," : "") << values[i];
+        }
+        os << "]";
+    }
+} // namespace
+
+void write_report_json(ostream &os, const BenchmarkReport &report)
+{
+    ios old_fmt(nullptr);
+    old_fmt.copyfmt(os);
+    os << fixed << setprecision(3);
+    os << "{\"unit\":\"us\",\"results\":[";
+    for (size_t i = 0; i < report.results.size(); i++)
+    {
+        auto &r = report.results[i];
+        os << (i ? ",\n" : "\n") << "{\"scheme\":\"" << r.scheme << "\",\"poly_modulus_degree\":" << r.poly_modulus_degree
+           << ",\"coeff_modulus_bits\":";
+        write_json_array(os, r.coeff_modulus_bits);
+        os << ",\"threads\":" << r.threads << ",\"operation\":\"" << r.operation << "\",\"count\":" << r.stats.count
+           << ",\"median\":" << r.stats.median << ",\"mean\":" << r.stats.mean << ",\"stddev\":" << r.stats.stddev
+           << ",\"p99\":" << r.stats.p99 << ",\"min\":" << r.stats.min << ",\"max\":" << r.stats.max
+           << ",\"ops_per_second\":" << r.ops_per_second;
+        if (r.scaling_efficiency > 0)
+        {
+            os << ",\"scaling_efficiency\":" << r.scaling_efficiency;
+        }
+        os << ",\"pool_bytes_before\":" << r.pool_bytes_before << ",\"pool_bytes_after\":" << r.pool_bytes_after;
+        if (r.peak_rss_available)
+        {
+            os << ",\"peak_rss_delta\":" << r.peak_rss_delta;
+        }
+        os << "}";
+    }
+    os << "\n]";
+
+    if (!report.footprints.empty())
+    {
+        os << ",\"footprints\":[";
+        for (size_t i = 0; i < report.footprints.size(); i++)
+        {
+            auto &f = report.footprints[i];
+            os << (i ? ",\n" : "\n") << "{\"scheme\":\"" << f.scheme << "\",\"poly_modulus_degree\":"
+               << f.poly_modulus_degree << ",\"coeff_modulus_bits\":";
+            write_json_array(os, f.coeff_modulus_bits);
+            os << ",\"secret_key_bytes\":" << f.secret_key_bytes << ",\"public_key_bytes\":" << f.public_key_bytes
+               << ",\"relin_keys_bytes\":" << f.relin_keys_bytes << ",\"galois_keys_bytes\":" << f.galois_keys_bytes
+               << ",\"ciphertext_bytes\":";
+            write_json_array(os, f.ciphertext_bytes);
+            os << "}";
+        }
+        os << "\n]";
+    }
+
+    if (!report.comparisons.empty())
+    {
+        os << ",\"comparisons\":[";
+        for (size_t i = 0; i < report.comparisons.size(); i++)
+        {
+            auto &c = report.comparisons[i];
+            os << (i ? ",\n" : "\n") << "{\"scheme\":\"" << c.scheme << "\",\"poly_modulus_degree\":"
+               << c.poly_modulus_degree << ",\"threads\":" << c.threads << ",\"operation\":\"" << c.operation
+               << "\",\"baseline\":\"" << c.baseline << "\",\"baseline_median\":" << c.baseline_median << ",\"median\":" << c.median
+               << ",\"change\":" << setprecision(4) << c.change << ",\"p_value\":" << scientific << c.p_value
+               << fixed << setprecision(3) << ",\"regression\":" << (c.regression ? "true" : "false")
+               << ",\"improvement\":" << (c.improvement ? "true" : "false") << "}";
+        }
+        os << "\n]";
+    }
+    os << "}" << endl;
+    os.copyfmt(old_fmt);
+}
+
+void write_report_csv(ostream &os, const BenchmarkReport &report)
+{
+    ios old_fmt(nullptr);
+    old_fmt.copyfmt(os);
+    os << fixed << setprecision(3);
+    os << "scheme,poly_modulus_degree,coeff_modulus_bits,threads,operation,count,median_us,mean_us,stddev_us,p99_us,"
+          "min_us,max_us,ops_per_second,scaling_efficiency,pool_bytes_before,pool_bytes_after,peak_rss_delta"
+       << endl;
+    for (auto &r : report.results)
+    {
+        os << r.scheme << "," << r.poly_modulus_degree << "," << join_bits(r.coeff_modulus_bits, ':') << ","
+           << r.threads << "," << r.operation << "," << r.stats.count << "," << r.stats.median << "," << r.stats.mean
+           << "," << r.stats.stddev << "," << r.stats.p99 << "," << r.stats.min << "," << r.stats.max << ","
+           << r.ops_per_second << ",";
+        if (r.scaling_efficiency > 0)
+        {
+            os << r.scaling_efficiency;
+        }
+        os << "," << r.pool_bytes_before << "," << r.pool_bytes_after << ",";
+        if (r.peak_rss_available)
+        {
+            os << r.peak_rss_delta;
+        }
+        os << endl;
+    }
+
+    if (!report.footprints.empty())
+    {
+        // Ciphertext sizes are ':'-separated, like the modulus bits, from chain index 0 upwards
+        os << endl
+           << "scheme,poly_modulus_degree,coeff_modulus_bits,secret_key_bytes,public_key_bytes,relin_keys_bytes,"
+              "galois_keys_bytes,ciphertext_bytes"
+           << endl;
+        for (auto &f : report.footprints)
+        {
+            os << f.scheme << "," << f.poly_modulus_degree << "," << join_bits(f.coeff_modulus_bits, ':') << ","
+               << f.secret_key_bytes << "," << f.public_key_bytes << "," << f.relin_keys_bytes << ","
+               << f.galois_keys_bytes << ",";
+            for (size_t i = 0; i < f.ciphertext_bytes.size(); i++)
+            {
+                os << (i ? ":" : "") << f.ciphertext_bytes[i];
+            }
+            os << endl;
+        }
+    }
+
+    if (!report.comparisons.empty())
+    {
+        os << endl
+           << "scheme,poly_modulus_degree,threads,operation,baseline,baseline_median_us,median_us,change,p_value,regression,"
+              "improvement"
+           << endl;
+        for (auto &c : report.comparisons)
+        {
+            os << c.scheme << "," << c.poly_modulus_degree << "," << c.threads << "," << c.operation << ","
+               << c.baseline << "," << c.baseline_median << "," << c.median << "," << setprecision(4) << c.change << "," << scientific
+               << c.p_value << fixed << setprecision(3) << "," << c.regression << "," << c.improvement << endl;
+        }
+    }
+    os.copyfmt(old_fmt);
+}
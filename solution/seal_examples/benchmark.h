@@ -0,0 +1,194 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+Summary of the samples of one operation. All times are in microseconds per call.
+*/
+struct BenchmarkStatistics
+{
+    std::size_t count = 0;
+    double median = 0;
+    double mean = 0;
+    double stddev = 0;
+    double p99 = 0;
+    double min = 0;
+    double max = 0;
+};
+
+BenchmarkStatistics summarize(std::vector<double> samples);
+
+/*
+One operation measured for one parameter set and thread count.
+*/
+struct BenchmarkResult
+{
+    std::string scheme;
+    std::size_t poly_modulus_degree = 0;
+    std::vector<int> coeff_modulus_bits;
+    std::size_t threads = 1;
+    std::string operation;
+    std::vector<double> samples;
+    BenchmarkStatistics stats;
+
+    /*
+    Calls per second of all threads together: the sum over the threads of their timed calls divided by the time
+    spent in them. The untimed input copies between calls do not count.
+    */
+    double ops_per_second = 0;
+
+    /*
+    ops_per_second / (threads * ops_per_second of the single-thread run); 1 means perfect scaling. The
+    single-thread run is always measured first, and only reported if 1 is among the requested thread counts.
+    */
+    double scaling_efficiency = 0;
+
+    /*
+    SEAL memory pool bytes (MemoryPool::alloc_byte_count) before the warm-up and after the timed calls; summed
+    over the threads' own pools with thread_local_pool. SEAL pools keep what they allocate, so growth shows the
+    working set the operation added.
+    */
+    std::size_t pool_bytes_before = 0;
+    std::size_t pool_bytes_after = 0;
+
+    /*
+    How far the peak resident set size rose above the resident set size at the start of the measurement, in
+    bytes. Only valid if peak_rss_available: that needs Linux and a writable /proc/self/clear_refs to reset the
+    peak before the measurement (otherwise the peak could be that of an earlier one).
+    */
+    std::size_t peak_rss_delta = 0;
+    bool peak_rss_available = false;
+};
+
+/*
+Memory held by the keys and ciphertexts of one parameter set, in bytes.
+*/
+struct BenchmarkFootprint
+{
+    std::string scheme;
+    std::size_t poly_modulus_degree = 0;
+    std::vector<int> coeff_modulus_bits;
+    std::size_t secret_key_bytes = 0;
+    std::size_t public_key_bytes = 0;
+    std::size_t relin_keys_bytes = 0;
+    std::size_t galois_keys_bytes = 0;
+
+    /*
+    ciphertext_bytes[i]: a size-2 ciphertext at chain index i (0 is the last level)
+    */
+    std::vector<std::size_t> ciphertext_bytes;
+};
+
+struct BenchmarkOptions
+{
+    std::vector<seal::scheme_type> schemes{ seal::scheme_type::ckks };
+
+    std::vector<std::size_t> degrees{ 4096, 8192, 16384 };
+
+    /*
+    Operation names as listed by benchmark_operations; empty selects all of them.
+    */
+    std::vector<std::string> operations;
+
+    /*
+    Timed calls per thread, after the untimed warm-up calls.
+    */
+    std::size_t iterations = 100;
+
+    std::size_t warmup = 10;
+
+    /*
+    Every operation is measured once for each thread count. With more than one thread, all threads run the
+    operation at the same time on their own inputs and every call contributes one sample.
+    */
+    std::vector<std::size_t> threads{ 1 };
+
+    /*
+    Give every thread its own SEAL memory pool (MMProfThreadLocal) instead of the global one, to separate
+    contention on the pool from limits such as memory bandwidth.
+    */
+    bool thread_local_pool = false;
+
+    /*
+    Also record a BenchmarkFootprint for every parameter set.
+    */
+    bool memory = false;
+};
+
+/*
+Operations of the throughput scaling mode: the CKKS pipeline from encoding to decoding.
+*/
+std::vector<std::string> scaling_operations();
+
+/*
+Thread counts of the scaling mode: 1, 2, 4, ... up to max_threads, which is always included.
+*/
+std::vector<std::size_t> scaling_thread_counts(std::size_t max_threads);
+
+/*
+Names of the operations that can be measured for a scheme.
+*/
+std::vector<std::string> benchmark_operations(seal::scheme_type scheme);
+
+/*
+A result compared against the stored baseline of the same host, parameter set, thread count and operation
+(see baseline.h).
+*/
+struct BenchmarkComparison
+{
+    std::string scheme;
+    std::size_t poly_modulus_degree = 0;
+    std::size_t threads = 1;
+    std::string operation;
+
+    /*
+    Stored baseline compared against: "last" (the last saved run) or "pinned" (see baseline.h)
+    */
+    std::string baseline = "last";
+    double baseline_median = 0;
+    double median = 0;
+
+    /*
+    median / baseline_median - 1, e.g. 0.1 for 10% slower
+    */
+    double change = 0;
+
+    /*
+    Two-sided Mann-Whitney U test of the two sets of samples
+    */
+    double p_value = 1;
+
+    /*
+    Significant at the chosen level and slower (faster) by more than the threshold
+    */
+    bool regression = false;
+    bool improvement = false;
+};
+
+struct BenchmarkReport
+{
+    std::vector<BenchmarkResult> results;
+    std::vector<BenchmarkFootprint> footprints;
+    std::vector<BenchmarkComparison> comparisons;
+};
+
+/*
+Runs the benchmarks selected by options and appends one result per parameter set, thread count and
+operation, and with options.memory one footprint per parameter set. Operations that the parameters do not
+support (e.g., relinearize without key switching) are skipped. Progress goes to progress if it is not null.
+*/
+void run_benchmarks(const BenchmarkOptions &options, BenchmarkReport &report, std::ostream *progress = nullptr);
+
+/*
+The writers add the footprints and comparisons, if any, after the results (in CSV as further tables, each
+after an empty line).
+*/
+void write_report_text(std::ostream &os, const BenchmarkReport &report);
+
+void write_report_json(std::ostream &os, const BenchmarkReport &report);
+
+void write_report_csv(std::ostream &os, const BenchmarkReport &report);
@@ -0,0 +1,408 @@
+#include "baseline.h"
+#include "benchmark.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+using namespace seal;
+
+/*
+Non-interactive counterpart of example_performance_test() for scripted runs:
+
+    sealbench --scheme ckks --degrees 8192,16384 --ops multiply,relinearize,rescale \
+        --iterations 200 --threads 1,8 --format json --output results.json
+
+Throughput scaling of the CKKS pipeline on up to 64 threads, with per-thread memory pools:
+
+    sealbench --degrees 16384 --scaling 64 --pool thread-local --format csv
+
+Every result includes the growth of the SEAL memory pool and the peak RSS during the measurement; --memory adds
+the sizes of the keys and of a ciphertext at every level.
+
+Nightly regression check against the previous run on the same host, which then becomes the new baseline unless
+it regressed (a slow run is never saved, so a regression cannot become the reference it is judged against). Every
+run is also compared against the pinned baseline, the first saved run, so that small slowdowns cannot add up
+unnoticed; after an accepted change in performance, --update-baseline pins the new run:
+
+    sealbench --degrees 8192,16384 --iterations 200 --compare baselines --save-baseline baselines
+    sealbench --degrees 8192,16384 --iterations 200 --save-baseline baselines --update-baseline
+*/
+
+namespace
+{
+    string join(const vector<string> &items)
+    {
+        string joined;
+        for (auto &item : items)
+        {
+            joined += (joined.empty() ? "" : ",") + item;
+        }
+        return joined;
+    }
+
+    void print_usage(ostream &os)
+    {
+        os << "Usage: sealbench [options]" << endl
+           << "  --scheme LIST       ckks, bfv or ckks,bfv (default ckks)" << endl
+           << "  --degrees LIST      poly_modulus_degree values (default 4096,8192,16384)" << endl
+           << "  --ops LIST          operations to run (default all; see --list)" << endl
+           << "  --iterations N      timed calls per thread and operation (default 100)" << endl
+           << "  --warmup N          untimed calls before timing (default 10)" << endl
+           << "  --threads LIST      concurrent threads per measurement (default 1)" << endl
+           << "  --scaling P|max     throughput scaling on 1, 2, 4, ... P threads (max: all hardware threads);" << endl
+           << "                      defaults --ops to " << join(scaling_operations()) << endl
+           << "  --pool POOL         global or thread-local SEAL memory pool (default global)" << endl
+           << "  --memory            also report key and per-level ciphertext sizes" << endl
+           << "  --format FORMAT     text, json or csv (default text)" << endl
+           << "  --output FILE       write results to FILE instead of stdout" << endl
+           << "  --save-baseline DIR store the samples as the last run of this host in DIR (skipped if --compare finds"
+           << endl
+           << "                      a regression); the first run saved is also pinned" << endl
+           << "  --update-baseline   with --save-baseline, also replace the pinned baseline (and save even if" << endl
+           << "                      --compare finds a regression)" << endl
+           << "  --compare DIR       compare against the last and the pinned baseline of this host in DIR; exits" << endl
+           << "                      with 2 on a regression" << endl
+           << "  --threshold PCT     median slowdown that counts as a regression (default 5)" << endl
+           << "  --alpha P           significance level of the Mann-Whitney test (default 0.01)" << endl
+           << "  --host NAME         host name for baselines (default: this machine's)" << endl
+           << "  --list              print the operations of each scheme and exit" << endl;
+    }
+
+    vector<string> split(const string &list)
+    {
+        vector<string> items;
+        stringstream ss(list);
+        string item;
+        while (getline(ss, item, ','))
+        {
+            if (!item.empty())
+            {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+    size_t parse_count(const string &value, const string &option)
+    {
+        size_t pos = 0;
+        unsigned long long count = 0;
+        try
+        {
+            count = stoull(value, &pos);
+        }
+        catch (const exception &)
+        {
+            pos = 0;
+        }
+        if (pos == 0 || pos != value.size())
+        {
+            throw invalid_argument("invalid value for " + option + ": " + value);
+        }
+        return static_cast<size_t>(count);
+    }
+
+    double parse_double(const string &value, const string &option)
+    {
+        size_t pos = 0;
+        double result = 0;
+        try
+        {
+            result = stod(value, &pos);
+        }
+        catch (const exception &)
+        {
+            pos = 0;
+        }
+        if (pos == 0 || pos != value.size() || !(result >= 0))
+        {
+            throw invalid_argument("invalid value for " + option + ": " + value);
+        }
+        return result;
+    }
+
+    vector<size_t> parse_counts(const string &list, const string &option)
+    {
+        vector<size_t> counts;
+        for (auto &item : split(list))
+        {
+            counts.push_back(parse_count(item, option));
+        }
+        if (counts.empty())
+        {
+            throw invalid_argument("empty list for " + option);
+        }
+        return counts;
+    }
+
+    scheme_type parse_scheme(const string &name)
+    {
+        if (name == "ckks")
+        {
+            return scheme_type::ckks;
+        }
+        if (name == "bfv")
+        {
+            return scheme_type::bfv;
+        }
+        throw invalid_argument("unknown scheme: " + name);
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    BenchmarkOptions options;
+    string format = "text";
+    string output;
+    size_t scaling = 0;
+    bool operations_set = false;
+    string save_dir;
+    bool update_baseline = false;
+    string compare_dir;
+    double threshold = 0.05;
+    double alpha = 0.01;
+    string host;
+
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                print_usage(cout);
+                return 0;
+            }
+            if (arg == "--list")
+            {
+                for (auto scheme : { scheme_type::ckks, scheme_type::bfv })
+                {
+                    cout << (scheme == scheme_type::ckks ? "ckks:" : "bfv:");
+                    for (auto &name : benchmark_operations(scheme))
+                    {
+                        cout << " " << name;
+                    }
+                    cout << endl;
+                }
+                return 0;
+            }
+            if (arg == "--memory")
+            {
+                options.memory = true;
+                continue;
+            }
+            if (arg == "--update-baseline")
+            {
+                update_baseline = true;
+                continue;
+            }
+            if (i + 1 == argc)
+            {
+                throw invalid_argument("missing value for " + arg);
+            }
+
+            string value = argv[++i];
+            if (arg == "--scheme")
+            {
+                options.schemes.clear();
+                for (auto &name : split(value))
+                {
+                    options.schemes.push_back(parse_scheme(name));
+                }
+            }
+            else if (arg == "--degrees")
+            {
+                options.degrees = parse_counts(value, arg);
+                for (auto degree : options.degrees)
+                {
+                    if (degree < 1024 || degree > 32768 || (degree & (degree - 1)) != 0)
+                    {
+                        throw invalid_argument("poly_modulus_degree must be a power of two in [1024, 32768]");
+                    }
+                }
+            }
+            else if (arg == "--ops")
+            {
+                options.operations = split(value);
+                operations_set = true;
+            }
+            else if (arg == "--iterations")
+            {
+                options.iterations = parse_count(value, arg);
+            }
+            else if (arg == "--warmup")
+            {
+                options.warmup = parse_count(value, arg);
+            }
+            else if (arg == "--threads")
+            {
+                options.threads = parse_counts(value, arg);
+                if (find(options.threads.begin(), options.threads.end(), size_t(0)) != options.threads.end())
+                {
+                    throw invalid_argument("thread counts must be positive");
+                }
+            }
+            else if (arg == "--scaling")
+            {
+                scaling = value == "max" ? max<size_t>(thread::hardware_concurrency(), 1) : parse_count(value, arg);
+                if (scaling == 0)
+                {
+                    throw invalid_argument("--scaling needs at least one thread");
+                }
+            }
+            else if (arg == "--pool")
+            {
+                if (value != "global" && value != "thread-local")
+                {
+                    throw invalid_argument("unknown pool: " + value);
+                }
+                options.thread_local_pool = value == "thread-local";
+            }
+            else if (arg == "--format")
+            {
+                format = value;
+                if (format != "text" && format != "json" && format != "csv")
+                {
+                    throw invalid_argument("unknown format: " + format);
+                }
+            }
+            else if (arg == "--output")
+            {
+                output = value;
+            }
+            else if (arg == "--save-baseline")
+            {
+                save_dir = value;
+            }
+            else if (arg == "--compare")
+            {
+                compare_dir = value;
+            }
+            else if (arg == "--threshold")
+            {
+                threshold = parse_double(value, arg) / 100;
+            }
+            else if (arg == "--alpha")
+            {
+                alpha = parse_double(value, arg);
+            }
+            else if (arg == "--host")
+            {
+                host = value;
+            }
+            else
+            {
+                throw invalid_argument("unknown option: " + arg);
+            }
+        }
+        if (scaling)
+        {
+            options.threads = scaling_thread_counts(scaling);
+            if (!operations_set)
+            {
+                options.operations = scaling_operations();
+            }
+        }
+        if (options.iterations == 0)
+        {
+            throw invalid_argument("--iterations must be positive");
+        }
+        if (update_baseline && save_dir.empty())
+        {
+            throw invalid_argument("--update-baseline needs --save-baseline");
+        }
+        for (auto &name : options.operations)
+        {
+            bool known = false;
+            for (auto scheme : options.schemes)
+            {
+                auto names = benchmark_operations(scheme);
+                known = known || find(names.begin(), names.end(), name) != names.end();
+            }
+            if (!known)
+            {
+                throw invalid_argument("unknown operation: " + name);
+            }
+        }
+    }
+    catch (const invalid_argument &e)
+    {
+        cerr << "sealbench: " << e.what() << endl;
+        print_usage(cerr);
+        return EXIT_FAILURE;
+    }
+
+    BenchmarkReport report;
+    try
+    {
+        run_benchmarks(options, report, &cerr);
+        if (host.empty())
+        {
+            host = benchmark_host();
+        }
+        // Compare before saving, so the same directory can serve as the previous and the next baseline
+        if (!compare_dir.empty())
+        {
+            report.comparisons = compare_to_baseline(compare_dir, host, report.results, threshold, alpha);
+        }
+        bool regressed = any_of(report.comparisons.begin(), report.comparisons.end(),
+                                [](const BenchmarkComparison &comparison) { return comparison.regression; });
+        if (!save_dir.empty() && regressed && !update_baseline)
+        {
+            cerr << "sealbench: not saving baselines to " << save_dir << " because of regressions" << endl;
+        }
+        else if (!save_dir.empty())
+        {
+            save_baseline(save_dir, host, report.results, update_baseline);
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << "sealbench: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    ofstream file;
+    if (!output.empty())
+    {
+        file.open(output);
+        if (!file)
+        {
+            cerr << "sealbench: cannot write " << output << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    ostream &os = output.empty() ? cout : file;
+    if (format == "json")
+    {
+        write_report_json(os, report);
+    }
+    else if (format == "csv")
+    {
+        write_report_csv(os, report);
+    }
+    else
+    {
+        write_report_text(os, report);
+    }
+    if (!os)
+    {
+        return EXIT_FAILURE;
+    }
+
+    size_t regressions = 0;
+    for (auto &comparison : report.comparisons)
+    {
+        regressions += comparison.regression;
+    }
+    if (regressions)
+    {
+        cerr << "sealbench: " << regressions << " regression(s) against the baseline of " << host << endl;
+        return 2;
+    }
+    return EXIT_SUCCESS;
+}
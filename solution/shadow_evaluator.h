@@ -0,0 +1,262 @@
+#pragma once
+
+#include "utils.h"
+
+/// A ciphertext together with the plaintext values it is supposed to encrypt.
+/// With tracking disabled it is just the ciphertext.
+template<bool Enabled>
+struct ShadowCiphertext;
+
+template<>
+struct ShadowCiphertext<true> {
+  seal::Ciphertext ctxt;
+  soa_cx_vector shadow;
+};
+
+template<>
+struct ShadowCiphertext<false> {
+  seal::Ciphertext ctxt;
+};
+
+/// One homomorphic operation as recorded by ShadowEvaluator
+struct ShadowStep {
+  std::string op;           ///< operation name, or the label passed to checkpoint()
+  double scale_bits;        ///< log2 of the scale of the result
+  std::size_t chain_index;  ///< level of the result (0 = last level)
+  std::size_t size;         ///< number of polynomials in the result
+  bool checked;             ///< true if the result was decrypted and metrics is valid
+  ErrorMetrics metrics;     ///< error of the decrypted result against the shadow plaintext
+};
+
+/// What ShadowEvaluator<true> keeps besides the Evaluator. ShadowEvaluator<false> derives from the empty
+/// specialization, so it holds nothing but the Evaluator reference.
+template<bool Enabled>
+struct ShadowTracking {
+  ShadowTracking(seal::SEALContext const &, seal::CKKSEncoder const &, seal::Decryptor *) {}
+};
+
+template<>
+struct ShadowTracking<true> {
+  ShadowTracking(seal::SEALContext const &context, seal::CKKSEncoder const &encoder, seal::Decryptor *decryptor)
+      : context_(context), encoder_(encoder), decryptor_(decryptor) {}
+
+  seal::SEALContext const &context_;
+  seal::CKKSEncoder const &encoder_;
+  seal::Decryptor *decryptor_;
+  bool check_every_op_ = false;
+  std::vector<ShadowStep> log_;
+};
+
+/// Wraps an Evaluator and mirrors every operation on a plaintext reference (using the soa_cx_vector evalPlain*
+/// helpers), so the error of any intermediate result can be measured by decrypting it and comparing against its shadow.
+/// ShadowEvaluator<false> forwards straight to the Evaluator and records nothing, so a circuit written against
+/// ShadowEvaluator<Enabled> can be compiled without any tracking overhead.
+///
+///   ShadowEvaluator<> shadow(context, evaluator, encoder, &decryptor);
+///   auto x = shadow.track(ctxt_x, 3.1);
+///   shadow.multiply_plain(x, plain_five, 5.0, x);
+///   shadow.rescale_to_next_inplace(x);
+///   shadow.checkpoint(x, "x*5");
+///   shadow.print_log();
+template<bool Enabled = true>
+class ShadowEvaluator : private ShadowTracking<Enabled> {
+ public:
+  typedef ShadowCiphertext<Enabled> ciphertext_type;
+
+  /// \param decryptor Used for checkpoints; without it only scales and levels are recorded
+  ShadowEvaluator(seal::SEALContext const &context, seal::Evaluator const &evaluator, seal::CKKSEncoder const &encoder,
+                  seal::Decryptor *decryptor = nullptr)
+      : ShadowTracking<Enabled>(context, encoder, decryptor), evaluator_(evaluator) {}
+
+  /// Measure the error after every operation instead of only at checkpoints (requires a decryptor)
+  void set_check_every_op(bool check) {
+    if constexpr (Enabled) {
+      this->check_every_op_ = check;
+    }
+  }
+
+  /// Start tracking a fresh ciphertext that encrypts the given values
+  ciphertext_type track(seal::Ciphertext const &ctxt, std::vector<cx_double> const &values) const {
+    ciphertext_type result;
+    result.ctxt = ctxt;
+    if constexpr (Enabled) {
+      result.shadow = padded(values);
+    }
+    return result;
+  }
+
+  /// Start tracking a fresh ciphertext that encrypts value in every slot
+  ciphertext_type track(seal::Ciphertext const &ctxt, cx_double value) const {
+    if constexpr (Enabled) {
+      return track(ctxt, std::vector<cx_double>(this->encoder_.slot_count(), value));
+    } else {
+      return ciphertext_type{ctxt};
+    }
+  }
+  void add(ciphertext_type const &a, ciphertext_type const &b, ciphertext_type &result) {
+    evaluator_.add(a.ctxt, b.ctxt, result.ctxt);
+    if constexpr (Enabled) {
+      evalPlainAdd(result.shadow, a.shadow, b.shadow);
+      record("add", result);
+    }
+  }
+
+  void sub(ciphertext_type const &a, ciphertext_type const &b, ciphertext_type &result) {
+    evaluator_.sub(a.ctxt, b.ctxt, result.ctxt);
+    if constexpr (Enabled) {
+      soa_cx_vector neg_b;
+      evalPlainNegate(neg_b, b.shadow);
+      evalPlainAdd(result.shadow, a.shadow, neg_b);
+      record("sub", result);
+    }
+  }
+
+  void multiply(ciphertext_type const &a, ciphertext_type const &b, ciphertext_type &result) {
+    evaluator_.multiply(a.ctxt, b.ctxt, result.ctxt);
+    if constexpr (Enabled) {
+      evalPlainMul(result.shadow, a.shadow, b.shadow);
+      record("multiply", result);
+    }
+  }
+
+  /// \param plain Encoded plaintext
+  /// \param values The values encoded in plain
+  void add_plain(ciphertext_type const &a, seal::Plaintext const &plain, std::vector<cx_double> const &values,
+                 ciphertext_type &result) {
+    evaluator_.add_plain(a.ctxt, plain, result.ctxt);
+    if constexpr (Enabled) {
+      evalPlainAdd(result.shadow, a.shadow, padded(values));
+      record("add_plain", result);
+    }
+  }
+
+  /// \param plain Encoded plaintext
+  /// \param value The value encoded in every slot of plain
+  void add_plain(ciphertext_type const &a, seal::Plaintext const &plain, cx_double value, ciphertext_type &result) {
+    if constexpr (Enabled) {
+      add_plain(a, plain, std::vector<cx_double>(this->encoder_.slot_count(), value), result);
+    } else {
+      evaluator_.add_plain(a.ctxt, plain, result.ctxt);
+    }
+  }
+
+  /// \param plain Encoded plaintext
+  /// \param values The values encoded in plain
+  void multiply_plain(ciphertext_type const &a, seal::Plaintext const &plain, std::vector<cx_double> const &values,
+                      ciphertext_type &result) {
+    evaluator_.multiply_plain(a.ctxt, plain, result.ctxt);
+    if constexpr (Enabled) {
+      evalPlainMul(result.shadow, a.shadow, padded(values));
+      record("multiply_plain", result);
+    }
+  }
+
+  /// \param plain Encoded plaintext
+  /// \param value The value encoded in every slot of plain
+  void multiply_plain(ciphertext_type const &a, seal::Plaintext const &plain, cx_double value,
+                      ciphertext_type &result) {
+    if constexpr (Enabled) {
+      multiply_plain(a, plain, std::vector<cx_double>(this->encoder_.slot_count(), value), result);
+    } else {
+      evaluator_.multiply_plain(a.ctxt, plain, result.ctxt);
+    }
+  }
+
+  void relinearize_inplace(ciphertext_type &a, seal::RelinKeys const &relin_keys) {
+    evaluator_.relinearize_inplace(a.ctxt, relin_keys);
+    if constexpr (Enabled) {
+      record("relinearize", a);
+    }
+  }
+
+  void rescale_to_next_inplace(ciphertext_type &a) {
+    evaluator_.rescale_to_next_inplace(a.ctxt);
+    if constexpr (Enabled) {
+      record("rescale_to_next", a);
+    }
+  }
+
+  void mod_switch_to_next_inplace(ciphertext_type &a) {
+    evaluator_.mod_switch_to_next_inplace(a.ctxt);
+    if constexpr (Enabled) {
+      record("mod_switch_to_next", a);
+    }
+  }
+
+  void mod_switch_to_inplace(ciphertext_type &a, seal::parms_id_type parms_id) {
+    evaluator_.mod_switch_to_inplace(a.ctxt, parms_id);
+    if constexpr (Enabled) {
+      record("mod_switch_to", a);
+    }
+  }
+
+  /// Decrypt a and log its error against the shadow plaintext (no-op without a decryptor)
+  void checkpoint(ciphertext_type const &a, std::string const &label) {
+    if constexpr (Enabled) {
+      record(label, a, true);
+    }
+  }
+
+  /// All recorded steps, in order (always empty without tracking)
+  std::vector<ShadowStep> const &log() const {
+    if constexpr (Enabled) {
+      return this->log_;
+    } else {
+      static std::vector<ShadowStep> const empty;
+      return empty;
+    }
+  }
+
+  /// Print one line per recorded step: scale, level and (where measured) the error
+  void print_log(std::ostream &os = std::cout) const {
+    std::ios old_fmt(nullptr);
+    old_fmt.copyfmt(os);
+    for (auto const &step : log()) {
+      os << std::setw(20) << std::left << step.op << std::right << std::fixed << std::setprecision(2)
+         << " scale: " << step.scale_bits << " bits, level: " << step.chain_index << ", size: " << step.size;
+      if (step.checked) {
+        os << std::scientific << ", max error: " << step.metrics.max_abs << std::fixed
+           << " (" << step.metrics.precision_bits << " bits)";
+      }
+      os << std::endl;
+    }
+    os.copyfmt(old_fmt);
+  }
+
+ private:
+  // Only called with tracking enabled; the bodies are discarded for ShadowEvaluator<false>, which has no shadows
+  soa_cx_vector padded(std::vector<cx_double> const &values) const {
+    soa_cx_vector result;
+    toSoaVector(result, values);
+    if constexpr (Enabled) {
+      result.resize(this->encoder_.slot_count());
+    }
+    return result;
+  }
+
+  void record(std::string const &op, ciphertext_type const &a, bool force_check = false) {
+    if constexpr (Enabled) {
+      ShadowStep step;
+      step.op = op;
+      step.scale_bits = std::log2(a.ctxt.scale());
+      step.chain_index = this->context_.get_context_data(a.ctxt.parms_id())->chain_index();
+      step.size = a.ctxt.size();
+      step.checked = this->decryptor_ && (force_check || this->check_every_op_);
+      if (step.checked) {
+        seal::Plaintext plain;
+        std::vector<cx_double> decoded, expected;
+        this->decryptor_->decrypt(a.ctxt, plain);
+        this->encoder_.decode(plain, decoded);
+        toComplexVector(expected, a.shadow);
+        step.metrics = errorMetrics(decoded, expected);
+      }
+      this->log_.push_back(std::move(step));
+    } else {
+      (void)op;
+      (void)a;
+      (void)force_check;
+    }
+  }
+
+  seal::Evaluator const &evaluator_;
+};
@@ -0,0 +1,135 @@
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled_{false};
+
+namespace {
+
+// Events of one thread: a singly linked list of fixed-size chunks. Only the owning thread appends; count is
+// published with release semantics, so a reader that loads it sees every event (and chunk link) before it.
+struct TraceChunk {
+  static constexpr std::size_t capacity = 4096;
+  TraceEvent events[capacity];
+  std::atomic<TraceChunk *> next{nullptr};
+};
+
+struct TraceBuffer {
+  std::uint32_t tid = 0;
+  std::atomic<std::size_t> count{0};
+  TraceChunk head;
+  TraceChunk *tail = &head;
+  std::size_t tail_count = 0;
+
+  ~TraceBuffer() { free_chunks(); }
+
+  void free_chunks() {
+    for (TraceChunk *chunk = head.next.load(); chunk;) {
+      TraceChunk *next = chunk->next.load();
+      delete chunk;
+      chunk = next;
+    }
+    head.next.store(nullptr);
+  }
+};
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<TraceBuffer>> registry; // buffers outlive their threads until written out
+
+TraceBuffer &thread_buffer() {
+  thread_local TraceBuffer *buffer = nullptr;
+  if (!buffer) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(std::make_unique<TraceBuffer>());
+    buffer = registry.back().get();
+    buffer->tid = static_cast<std::uint32_t>(registry.size());
+  }
+  return *buffer;
+}
+
+void write_escaped(std::ostream &os, char const *s) {
+  os << '"';
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      os << '\\';
+    }
+    os << *s;
+  }
+  os << '"';
+}
+
+} // namespace
+
+std::uint64_t Tracer::now() {
+  static auto const epoch = std::chrono::steady_clock::now();
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+
+void Tracer::record(TraceEvent const &event) {
+  TraceBuffer &buffer = thread_buffer();
+  if (buffer.tail_count == TraceChunk::capacity) {
+    auto chunk = new TraceChunk;
+    buffer.tail->next.store(chunk, std::memory_order_release);
+    buffer.tail = chunk;
+    buffer.tail_count = 0;
+  }
+  buffer.tail->events[buffer.tail_count++] = event;
+  buffer.count.store(buffer.count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Tracer::write_json(std::ostream &os) {
+  std::ios old_fmt(nullptr);
+  old_fmt.copyfmt(os);
+  os << std::fixed << std::setprecision(3);
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (auto const &buffer : registry) {
+    std::size_t count = buffer->count.load(std::memory_order_acquire);
+    TraceChunk const *chunk = &buffer->head;
+    for (std::size_t i = 0; i < count; i++) {
+      if (i > 0 && i % TraceChunk::capacity == 0) {
+        chunk = chunk->next.load(std::memory_order_acquire);
+      }
+      TraceEvent const &e = chunk->events[i % TraceChunk::capacity];
+      os << (first ? "\n" : ",\n") << "{\"name\":";
+      write_escaped(os, e.name);
+      os << ",\"cat\":";
+      write_escaped(os, e.category);
+      os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << e.begin / 1000.0
+         << ",\"dur\":" << (e.end - e.begin) / 1000.0;
+      if (e.level >= 0) {
+        os << ",\"args\":{\"level\":" << e.level << ",\"size\":" << e.size << "}";
+      }
+      os << "}";
+      first = false;
+    }
+  }
+  os << "\n]}" << std::endl;
+  os.copyfmt(old_fmt);
+}
+
+bool Tracer::write_json(std::string const &path) {
+  std::ofstream out(path);
+  if (!out) {
+    return false;
+  }
+  write_json(out);
+  return static_cast<bool>(out);
+}
+
+void Tracer::clear() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (auto &buffer : registry) {
+    buffer->free_chunks();
+    buffer->tail = &buffer->head;
+    buffer->tail_count = 0;
+    buffer->count.store(0, std::memory_order_release);
+  }
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <seal/seal.h>
+
+/// One recorded call
+struct TraceEvent {
+  char const *name;      ///< string literal
+  char const *category;  ///< string literal, e.g. "evaluator" or "kernel"
+  std::uint64_t begin;   ///< nanoseconds since the trace epoch
+  std::uint64_t end;
+  std::int32_t level;    ///< chain index of the ciphertext involved, -1 if none
+  std::int32_t size;     ///< number of polynomials in that ciphertext, -1 if none
+};
+
+/// Process-wide operation tracing, written out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+/// Every thread records into its own append-only buffer without locks or shared cache lines, so tracing adds
+/// two clock reads per call; with tracing disabled a TraceScope costs one relaxed atomic load.
+class Tracer {
+ public:
+  static void enable(bool on = true) { enabled_.store(on, std::memory_order_relaxed); }
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  /// Append an event to the calling thread's buffer
+  static void record(TraceEvent const &event);
+
+  /// Nanoseconds since the trace epoch
+  static std::uint64_t now();
+
+  /// Write all recorded events as Chrome trace JSON; may run while other threads keep recording
+  static void write_json(std::ostream &os);
+
+  /// \return false if the file cannot be written
+  static bool write_json(std::string const &path);
+
+  /// Drop all recorded events; must not run while other threads record
+  static void clear();
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+/// Records the lifetime of the scope as one event when tracing is enabled
+///
+///   TraceScope scope("multiply", "evaluator", ctxt);
+///   evaluator.multiply_inplace(ctxt, other);
+///   scope.set(ctxt); // report the result's level and size instead
+class TraceScope {
+ public:
+  /// \param name, category Must be string literals (or otherwise outlive the trace)
+  TraceScope(char const *name, char const *category) {
+    if (Tracer::enabled()) {
+      active_ = true;
+      event_ = TraceEvent{name, category, Tracer::now(), 0, -1, -1};
+    }
+  }
+
+  TraceScope(char const *name, char const *category, seal::Ciphertext const &ctxt) : TraceScope(name, category) {
+    set(ctxt);
+  }
+
+  ~TraceScope() {
+    if (active_) {
+      event_.end = Tracer::now();
+      Tracer::record(event_);
+    }
+  }
+
+  TraceScope(TraceScope const &) = delete;
+  TraceScope &operator=(TraceScope const &) = delete;
+
+  /// Report the level and size of this ciphertext
+  void set(seal::Ciphertext const &ctxt) {
+    if (active_) {
+      event_.level = static_cast<std::int32_t>(ctxt.coeff_modulus_size()) - 1;
+      event_.size = static_cast<std::int32_t>(ctxt.size());
+    }
+  }
+
+  /// Report the level of this CKKS plaintext, which holds one polynomial of poly_modulus_degree coefficients per prime
+  void set(seal::Plaintext const &plain, std::size_t poly_modulus_degree) {
+    if (active_ && poly_modulus_degree) {
+      event_.level = static_cast<std::int32_t>(plain.coeff_count() / poly_modulus_degree) - 1;
+      event_.size = 1;
+    }
+  }
+
+ private:
+  bool active_ = false;
+  TraceEvent event_;
+};
+
+/// Thin wrappers that record every call as one TraceScope with the level and size of the ciphertext (or plaintext)
+/// the call produces, or consumes for decrypt and decode. Code written against the SEAL objects keeps its shape:
+///
+///   TracedEvaluator evaluator(shared->evaluator());
+///   evaluator.multiply(a, b, c); // one "multiply" event at the level and size of c
+///
+/// Each wrapper converts to a reference to the wrapped object, for functions that take the SEAL type.
+class TracedEvaluator {
+ public:
+  explicit TracedEvaluator(seal::Evaluator const &evaluator) : evaluator_(evaluator) {}
+  operator seal::Evaluator const &() const { return evaluator_; }
+
+  void add(seal::Ciphertext const &a, seal::Ciphertext const &b, seal::Ciphertext &result) const {
+    TraceScope scope("add", "evaluator");
+    evaluator_.add(a, b, result);
+    scope.set(result);
+  }
+
+  void sub(seal::Ciphertext const &a, seal::Ciphertext const &b, seal::Ciphertext &result) const {
+    TraceScope scope("sub", "evaluator");
+    evaluator_.sub(a, b, result);
+    scope.set(result);
+  }
+
+  void multiply(seal::Ciphertext const &a, seal::Ciphertext const &b, seal::Ciphertext &result) const {
+    TraceScope scope("multiply", "evaluator");
+    evaluator_.multiply(a, b, result);
+    scope.set(result);
+  }
+
+  void add_plain(seal::Ciphertext const &a, seal::Plaintext const &plain, seal::Ciphertext &result) const {
+    TraceScope scope("add_plain", "evaluator");
+    evaluator_.add_plain(a, plain, result);
+    scope.set(result);
+  }
+
+  void multiply_plain(seal::Ciphertext const &a, seal::Plaintext const &plain, seal::Ciphertext &result) const {
+    TraceScope scope("multiply_plain", "evaluator");
+    evaluator_.multiply_plain(a, plain, result);
+    scope.set(result);
+  }
+
+  void relinearize_inplace(seal::Ciphertext &a, seal::RelinKeys const &relin_keys) const {
+    TraceScope scope("relinearize", "evaluator");
+    evaluator_.relinearize_inplace(a, relin_keys);
+    scope.set(a);
+  }
+
+  void rescale_to_next_inplace(seal::Ciphertext &a) const {
+    TraceScope scope("rescale", "evaluator");
+    evaluator_.rescale_to_next_inplace(a);
+    scope.set(a);
+  }
+
+  void mod_switch_to_next(seal::Ciphertext const &a, seal::Ciphertext &result) const {
+    TraceScope scope("mod_switch", "evaluator");
+    evaluator_.mod_switch_to_next(a, result);
+    scope.set(result);
+  }
+
+  void mod_switch_to_next_inplace(seal::Ciphertext &a) const {
+    TraceScope scope("mod_switch", "evaluator");
+    evaluator_.mod_switch_to_next_inplace(a);
+    scope.set(a);
+  }
+
+ private:
+  seal::Evaluator const &evaluator_;
+};
+
+class TracedEncryptor {
+ public:
+  explicit TracedEncryptor(seal::Encryptor const &encryptor) : encryptor_(encryptor) {}
+  operator seal::Encryptor const &() const { return encryptor_; }
+
+  void encrypt(seal::Plaintext const &plain, seal::Ciphertext &result) const {
+    TraceScope scope("encrypt", "encryptor");
+    encryptor_.encrypt(plain, result);
+    scope.set(result);
+  }
+
+ private:
+  seal::Encryptor const &encryptor_;
+};
+
+class TracedDecryptor {
+ public:
+  explicit TracedDecryptor(seal::Decryptor &decryptor) : decryptor_(decryptor) {}
+  operator seal::Decryptor &() const { return decryptor_; }
+
+  void decrypt(seal::Ciphertext const &ctxt, seal::Plaintext &result) const {
+    TraceScope scope("decrypt", "decryptor", ctxt);
+    decryptor_.decrypt(ctxt, result);
+  }
+
+ private:
+  seal::Decryptor &decryptor_;
+};
+
+class TracedEncoder {
+ public:
+  explicit TracedEncoder(seal::CKKSEncoder const &encoder) : encoder_(encoder) {}
+  operator seal::CKKSEncoder const &() const { return encoder_; }
+
+  std::size_t slot_count() const { return encoder_.slot_count(); }
+
+  /// \param values A number (encoded into every slot) or a vector of real or complex numbers
+  template<class T>
+  void encode(T const &values, double scale, seal::Plaintext &result) const {
+    TraceScope scope("encode", "encoder");
+    encoder_.encode(values, scale, result);
+    scope.set(result, 2 * encoder_.slot_count());
+  }
+
+  template<class T>
+  void encode(T const &values, seal::parms_id_type const &parms_id, double scale, seal::Plaintext &result) const {
+    TraceScope scope("encode", "encoder");
+    encoder_.encode(values, parms_id, scale, result);
+    scope.set(result, 2 * encoder_.slot_count());
+  }
+
+  template<class T>
+  void decode(seal::Plaintext const &plain, std::vector<T> &result) const {
+    TraceScope scope("decode", "encoder");
+    scope.set(plain, 2 * encoder_.slot_count());
+    encoder_.decode(plain, result);
+  }
+
+ private:
+  seal::CKKSEncoder const &encoder_;
+};
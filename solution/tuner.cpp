@@ -0,0 +1,171 @@
+#include "tuner.h"
+
+using namespace seal;
+
+namespace {
+
+TunerCandidate make_layout(std::size_t n, std::size_t levels, int scale_bits, TunerRequirements const &requirements) {
+  TunerCandidate result;
+  result.poly_modulus_degree = n;
+  result.scale_bits = scale_bits;
+  result.coeff_modulus_bits.assign(levels + 2, scale_bits);
+  result.coeff_modulus_bits.front() = result.coeff_modulus_bits.back() = scale_bits + requirements.integer_bits;
+  return result;
+}
+
+// Largest-scale layout with the given levels for ring dimension n, if any fits. The first prime has to hold the
+// scale and the integer bits, and SEAL's primes have at most 60 bits, which caps the scale.
+bool fit_layout(std::size_t n, std::size_t levels, TunerRequirements const &requirements, TunerCandidate &result) {
+  if (requirements.integer_bits < 0 || requirements.integer_bits > 40) {
+    throw std::invalid_argument("integer_bits must be in [0, 40]");
+  }
+  int max_bits = CoeffModulus::MaxBitCount(n, requirements.sec_level);
+  for (int scale_bits = 60 - requirements.integer_bits; scale_bits >= 20; scale_bits--) {
+    result = make_layout(n, levels, scale_bits, requirements);
+    if (std::accumulate(result.coeff_modulus_bits.begin(), result.coeff_modulus_bits.end(), 0) <= max_bits) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Benchmark the circuit with the candidate's parameters. Returns false if the compiled circuit needs more levels
+// than the layout has; SEAL's errors for parameters it rejects (std::logic_error) are passed on.
+bool measure(Circuit const &circuit, Expr const &output, TunerRequirements const &requirements,
+             TunerCandidate &candidate) {
+  SEALContext context(candidate.parameters(), true, requirements.sec_level);
+  if (!context.parameters_set()) {
+    throw std::invalid_argument(context.parameter_error_message());
+  }
+  double scale = std::pow(2.0, candidate.scale_bits);
+  CompiledCircuit compiled;
+  try {
+    // Candidates are compared by what the circuit really costs on them, including any level spent on realigning
+    compiled = circuit.compile(output, context, scale, ScaleMismatch::realign);
+  } catch (std::invalid_argument const &) {
+    return false; // modulus chain is too short
+  }
+
+  KeyGenerator keygen(context);
+  PublicKey public_key;
+  keygen.create_public_key(public_key);
+  RelinKeys relin_keys;
+  keygen.create_relin_keys(relin_keys);
+  Encryptor encryptor(context, public_key);
+  Decryptor decryptor(context, keygen.secret_key());
+  Evaluator evaluator(context);
+  CKKSEncoder encoder(context);
+  PlaintextCache cache(encoder);
+
+  std::size_t slot_count = encoder.slot_count();
+  std::vector<std::vector<double>> columns(compiled.input_count(), std::vector<double>(slot_count));
+  std::vector<Ciphertext> inputs(columns.size());
+  for (std::size_t j = 0; j < columns.size(); j++) {
+    randomUniform(columns[j].data(), slot_count, default_random_seed, j);
+    for (auto &v : columns[j]) {
+      v = (2 * v - 1) * requirements.input_bound;
+    }
+    Plaintext plain;
+    encoder.encode(columns[j], scale, plain);
+    encryptor.encrypt(plain, inputs[j]);
+  }
+
+  Ciphertext result;
+  std::vector<double> times;
+  for (std::size_t r = 0; r < std::max<std::size_t>(requirements.repetitions, 1); r++) {
+    auto start = std::chrono::steady_clock::now();
+    compiled.run(inputs, result, evaluator, encoder, &relin_keys, &cache);
+    auto stop = std::chrono::steady_clock::now();
+    times.push_back(std::chrono::duration<double>(stop - start).count());
+  }
+  std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+
+  Plaintext plain_result;
+  std::vector<double> decoded;
+  decryptor.decrypt(result, plain_result);
+  encoder.decode(plain_result, decoded);
+  std::vector<double> expected = circuit.evaluate(output, columns);
+
+  candidate.measured = true;
+  candidate.seconds = times[times.size() / 2];
+  candidate.precision_bits = errorMetrics(std::vector<cx_double>(decoded.begin(), decoded.end()),
+                                          std::vector<cx_double>(expected.begin(), expected.end())).precision_bits;
+  return true;
+}
+
+} // namespace
+
+EncryptionParameters TunerCandidate::parameters() const {
+  EncryptionParameters parms(scheme_type::ckks);
+  parms.set_poly_modulus_degree(poly_modulus_degree);
+  parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, coeff_modulus_bits));
+  return parms;
+}
+
+std::vector<TunerCandidate> enumerateParameters(std::size_t levels, TunerRequirements const &requirements) {
+  std::vector<TunerCandidate> result;
+  for (std::size_t n = 4096; n <= 32768; n *= 2) {
+    if (n / 2 < requirements.min_slots) {
+      continue;
+    }
+    TunerCandidate largest;
+    if (!fit_layout(n, levels, requirements, largest)) {
+      continue;
+    }
+    for (int scale_bits = largest.scale_bits; scale_bits >= 20; scale_bits--) {
+      result.push_back(make_layout(n, levels, scale_bits, requirements));
+    }
+  }
+  return result;
+}
+
+TunerCandidate tuneParameters(Circuit const &circuit, Expr const &output, TunerRequirements const &requirements,
+                              std::vector<TunerCandidate> *measured) {
+  std::size_t depth = circuit.depth(output);
+  TunerCandidate best;
+  for (std::size_t n = 4096; n <= 32768; n *= 2) {
+    if (n / 2 < requirements.min_slots) {
+      continue;
+    }
+    // Scale mismatches inside the circuit can cost the compiler a level or two on top of the symbolic depth
+    bool enough_levels = false;
+    for (std::size_t levels = std::max<std::size_t>(depth, 1); levels <= depth + 2 && !enough_levels; levels++) {
+      TunerCandidate largest;
+      if (!fit_layout(n, levels, requirements, largest)) {
+        break;
+      }
+      // Smaller scales are not faster, but leave more room for the integer part and for rescaling errors, so
+      // walk down from the largest one until the precision is met or stops improving
+      double previous_precision = -std::numeric_limits<double>::infinity();
+      enough_levels = true;
+      for (int scale_bits = largest.scale_bits; scale_bits >= 20; scale_bits--) {
+        TunerCandidate candidate = make_layout(n, levels, scale_bits, requirements);
+        try {
+          enough_levels = measure(circuit, output, requirements, candidate);
+        } catch (std::logic_error const &) {
+          continue; // SEAL rejected the layout, e.g. too few primes of this size
+        }
+        if (!enough_levels) {
+          break;
+        }
+        if (measured) {
+          measured->push_back(candidate);
+        }
+        if (candidate.precision_bits >= requirements.precision_bits) {
+          if (!best.measured || candidate.seconds < best.seconds) {
+            best = candidate;
+          }
+          break;
+        }
+        if (candidate.precision_bits <= previous_precision) {
+          break;
+        }
+        previous_precision = candidate.precision_bits;
+      }
+    }
+  }
+  if (!best.measured) {
+    throw std::invalid_argument("no encryption parameters meet the requirements");
+  }
+  return best;
+}
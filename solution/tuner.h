@@ -0,0 +1,44 @@
+#pragma once
+
+#include "circuit.h"
+
+/// What the encryption parameters have to deliver
+struct TunerRequirements {
+  double precision_bits = 20;                                ///< required -log2 of the largest error (see ErrorMetrics)
+  seal::sec_level_type sec_level = seal::sec_level_type::tc128;
+  int integer_bits = 10;                                     ///< headroom above the scale for the integer part of values (0-40)
+  double input_bound = 1.0;                                  ///< inputs are sampled uniformly from [-input_bound, input_bound]
+  std::size_t min_slots = 0;                                 ///< smallest acceptable number of slots
+  std::size_t repetitions = 5;                               ///< timed runs per candidate (the median counts)
+};
+
+/// One modulus layout {first prime, levels x scale prime, special prime} for one ring dimension
+struct TunerCandidate {
+  std::size_t poly_modulus_degree = 0;
+  std::vector<int> coeff_modulus_bits;
+  int scale_bits = 0;
+  bool measured = false;     ///< true if seconds and precision_bits were measured
+  double seconds = 0;        ///< median time of one run of the compiled circuit
+  double precision_bits = 0; ///< measured precision of the circuit's result
+
+  /// CKKS parameters for this layout
+  seal::EncryptionParameters parameters() const;
+
+  /// Multiplicative levels available to a circuit
+  std::size_t levels() const { return coeff_modulus_bits.size() - 2; }
+};
+
+/// All layouts with the given number of levels that fit the security level, from the smallest ring and largest
+/// scale up. For every ring dimension and scale, the first and special primes are scale + integer_bits, so scales
+/// are at most 60 - integer_bits.
+std::vector<TunerCandidate> enumerateParameters(std::size_t levels, TunerRequirements const &requirements);
+
+/// Pick CKKS parameters for a circuit by measurement: for every ring dimension the scales that fit the circuit's
+/// depth are benchmarked from the largest down until one meets the required precision (or the precision stops
+/// improving), and the fastest candidate that meets it wins. Layouts the circuit compiler needs extra levels for
+/// get them.
+/// \param circuit, output The computation to tune for
+/// \param measured If given, receives every benchmarked candidate
+/// \throws std::invalid_argument if no candidate meets the requirements or integer_bits is out of range
+TunerCandidate tuneParameters(Circuit const &circuit, Expr const &output, TunerRequirements const &requirements,
+                              std::vector<TunerCandidate> *measured = nullptr);
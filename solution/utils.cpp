@@ -1,6 +1,11 @@
 #include "utils.h"
+#include "trace.h"
 #include <seal/util/uintarithsmallmod.h>
 #include <seal/util/polyarithsmallmod.h>
+#include <seal/util/common.h>
+#include <atomic>
+#include <map>
+#include <tuple>
 
 using namespace seal;
 
@@ -12,6 +17,7 @@ using namespace seal;
 // return if the inverse exists, and result is also in evaluation representation
 bool inverse(util::ConstCoeffIter a, std::size_t coeff_count, std::vector<Modulus> const& coeff_modulus,
              util::CoeffIter result) {
+  TraceScope scope("inverse", "kernel");
   bool * has_inv = new bool[coeff_modulus.size()];
   std::fill_n(has_inv, coeff_modulus.size(), true);
 #pragma omp parallel for
@@ -34,6 +40,7 @@ bool inverse(util::ConstCoeffIter a, std::size_t coeff_count, std::vector<Modulu
 
 void multiply(util::ConstCoeffIter a, util::ConstCoeffIter b, std::size_t coeff_count,
               std::vector<Modulus> const& coeff_modulus, util::CoeffIter result) {
+  TraceScope scope("multiply", "kernel");
 #pragma omp parallel for
   for (size_t j = 0; j < coeff_modulus.size(); j++) {
     util::dyadic_product_coeffmod(a + (j * coeff_count),
@@ -46,6 +53,7 @@ void multiply(util::ConstCoeffIter a, util::ConstCoeffIter b, std::size_t coeff_
 
 void add(util::ConstCoeffIter a, util::ConstCoeffIter b, std::size_t coeff_count,
          std::vector<Modulus> const& coeff_modulus, util::CoeffIter result) {
+  TraceScope scope("add", "kernel");
 #pragma omp parallel for
   for (size_t j = 0; j < coeff_modulus.size(); j++) {
     util::add_poly_coeffmod(a + (j * coeff_count),
@@ -58,6 +66,7 @@ void add(util::ConstCoeffIter a, util::ConstCoeffIter b, std::size_t coeff_count
 
 void sub(util::ConstCoeffIter a, util::ConstCoeffIter b, std::size_t coeff_count,
          std::vector<Modulus> const& coeff_modulus, util::CoeffIter result) {
+  TraceScope scope("sub", "kernel");
 #pragma omp parallel for
   for (size_t j = 0; j < coeff_modulus.size(); j++) {
     util::sub_poly_coeffmod(a + (j * coeff_count),
@@ -68,8 +77,117 @@ void sub(util::ConstCoeffIter a, util::ConstCoeffIter b, std::size_t coeff_count
   }
 }
 
+namespace {
+
+// Gather form of X -> X^k: result[j] = a[index[j]], negated (mod q_i) wherever negate[j] is all-ones.
+// In eval_rep the automorphism is a pure permutation of the NTT slots, so negate stays empty.
+struct GaloisTable {
+  std::vector<std::uint32_t> index;
+  std::vector<std::uint64_t> negate;
+};
+
+std::shared_ptr<const GaloisTable> galois_table(std::size_t coeff_count, std::uint32_t galois_elt, bool ntt_form) {
+  static std::mutex mutex;
+  static std::map<std::tuple<std::size_t, std::uint32_t, bool>, std::shared_ptr<const GaloisTable>> cache;
+
+  auto key = std::make_tuple(coeff_count, galois_elt, ntt_form);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+      return it->second;
+    }
+  }
+
+  if (coeff_count < 2 || (coeff_count & (coeff_count - 1)) != 0) {
+    throw std::invalid_argument("coeff_count must be a power of two");
+  }
+  if (!(galois_elt & 1) || galois_elt >= 2 * coeff_count) {
+    throw std::invalid_argument("galois_elt must be odd and smaller than 2*coeff_count");
+  }
+
+  int coeff_count_power = util::get_power_of_two(coeff_count);
+  std::uint64_t mask = coeff_count - 1;
+  auto table = std::make_shared<GaloisTable>();
+  table->index.resize(coeff_count);
+
+  if (ntt_form) {
+    // Same ordering as SEAL's GaloisTool::apply_galois_ntt
+    for (std::size_t i = 0; i < coeff_count; i++) {
+      auto reversed = util::reverse_bits<std::uint32_t>(static_cast<std::uint32_t>(coeff_count + i),
+                                                        coeff_count_power + 1);
+      std::uint64_t index_raw = ((static_cast<std::uint64_t>(galois_elt) * reversed) >> 1) & mask;
+      table->index[i] = util::reverse_bits<std::uint32_t>(static_cast<std::uint32_t>(index_raw), coeff_count_power);
+    }
+  } else {
+    // X^i -> X^(i*k mod 2N), and X^N = -1
+    table->negate.resize(coeff_count);
+    std::uint64_t index_raw = 0;
+    for (std::size_t i = 0; i < coeff_count; i++, index_raw += galois_elt) {
+      std::uint64_t j = index_raw & mask;
+      table->index[j] = static_cast<std::uint32_t>(i);
+      table->negate[j] = ((index_raw >> coeff_count_power) & 1) ? ~std::uint64_t(0) : 0;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return cache.emplace(key, std::move(table)).first->second;
+}
+
+void apply_galois_table(std::uint64_t const *__restrict src, GaloisTable const &table, std::size_t coeff_count,
+                        Modulus const &modulus, std::uint64_t *__restrict dst) {
+  std::uint32_t const *index = table.index.data();
+  if (table.negate.empty()) {
+#pragma omp simd
+    for (std::size_t j = 0; j < coeff_count; j++) {
+      dst[j] = src[index[j]];
+    }
+  } else {
+    std::uint64_t const *negate = table.negate.data();
+    std::uint64_t q = modulus.value();
+#pragma omp simd
+    for (std::size_t j = 0; j < coeff_count; j++) {
+      std::uint64_t v = src[index[j]];
+      std::uint64_t neg_v = (q - v) & (~std::uint64_t(0) + (v == 0)); // -0 stays 0
+      dst[j] = (v & ~negate[j]) | (neg_v & negate[j]);
+    }
+  }
+}
+
+} // namespace
+
+void apply_galois(util::ConstCoeffIter a, std::size_t coeff_count, std::vector<Modulus> const& coeff_modulus,
+                  std::uint32_t galois_elt, bool ntt_form, util::CoeffIter result) {
+  TraceScope scope("apply_galois", "kernel");
+  auto table = galois_table(coeff_count, galois_elt, ntt_form);
+#pragma omp parallel for
+  for (size_t j = 0; j < coeff_modulus.size(); j++) {
+    apply_galois_table(a + (j * coeff_count), *table, coeff_count, coeff_modulus[j], result + (j * coeff_count));
+  }
+}
+
+void apply_galois_many(util::ConstCoeffIter a, std::size_t coeff_count, std::vector<Modulus> const& coeff_modulus,
+                       std::vector<std::uint32_t> const& galois_elts, bool ntt_form, util::CoeffIter results) {
+  TraceScope scope("apply_galois_many", "kernel");
+  std::vector<std::shared_ptr<const GaloisTable>> tables;
+  tables.reserve(galois_elts.size());
+  for (auto galois_elt : galois_elts) {
+    tables.push_back(galois_table(coeff_count, galois_elt, ntt_form));
+  }
+
+  size_t poly_size = coeff_count * coeff_modulus.size();
+#pragma omp parallel for collapse(2)
+  for (size_t k = 0; k < tables.size(); k++) {
+    for (size_t j = 0; j < coeff_modulus.size(); j++) {
+      apply_galois_table(a + (j * coeff_count), *tables[k], coeff_count, coeff_modulus[j],
+                         results + (k * poly_size + j * coeff_count));
+    }
+  }
+}
+
 void copy(util::ConstCoeffIter a, std::size_t coeff_count, std::size_t coeff_modulus_count,
           util::CoeffIter result) {
+  TraceScope scope("copy", "kernel");
 #pragma omp parallel for
   for (size_t i = 0; i < coeff_modulus_count; i++) {
     util::set_poly(a + (i * coeff_count), coeff_count, 1, result + (i * coeff_count));
@@ -77,6 +195,7 @@ void copy(util::ConstCoeffIter a, std::size_t coeff_count, std::size_t coeff_mod
 }
 
 void to_eval_rep(util::CoeffIter a, size_t coeff_count, size_t coeff_modulus_count, util::NTTTables const* small_ntt_tables) {
+  TraceScope scope("to_eval_rep", "kernel");
 #pragma omp parallel for
   for (size_t j = 0; j < coeff_modulus_count; j++) {
     util::ntt_negacyclic_harvey(a + (j * coeff_count), small_ntt_tables[j]); // ntt form
@@ -84,99 +203,177 @@ void to_eval_rep(util::CoeffIter a, size_t coeff_count, size_t coeff_modulus_cou
 }
 
 void to_coeff_rep(util::CoeffIter a, size_t coeff_count, size_t coeff_modulus_count, util::NTTTables const* small_ntt_tables) {
+  TraceScope scope("to_coeff_rep", "kernel");
 #pragma omp parallel for
   for (size_t j = 0; j < coeff_modulus_count; j++) {
     util::inverse_ntt_negacyclic_harvey(a + (j * coeff_count), small_ntt_tables[j]); // non-ntt form
   }
 }
 
-long double infty_norm(util::ConstCoeffIter a, SEALContext::ContextData const* context_data) {
-  auto &ciphertext_parms = context_data->parms();
-  auto &coeff_modulus = ciphertext_parms.coeff_modulus();
-  size_t coeff_mod_count = coeff_modulus.size();
-  size_t coeff_count = ciphertext_parms.poly_modulus_degree();
-  auto decryption_modulus = context_data->total_coeff_modulus();
-  auto upper_half_threshold = context_data->upper_half_threshold();
+namespace {
 
-  long double max = 0;
+typedef unsigned __int128 uint128_t;
+
+// acc[0..count] += p[0..count-1] * y, where acc has one extra word to absorb the carry
+inline void multiply_add_uint(std::uint64_t const *p, std::size_t count, std::uint64_t y, std::uint64_t *acc) {
+  uint128_t carry = 0;
+  for (std::size_t w = 0; w < count; w++) {
+    carry += static_cast<uint128_t>(p[w]) * y + acc[w];
+    acc[w] = static_cast<std::uint64_t>(carry);
+    carry >>= 64;
+  }
+  acc[count] += static_cast<std::uint64_t>(carry);
+}
 
-  auto aCopy(util::allocate_zero_poly(coeff_count, coeff_mod_count, MemoryManager::GetPool()));
-  copy(a, coeff_count, coeff_mod_count, aCopy.get());
+// acc (count + 1 words) is a sum of at most count values < q: bring it back into [0, q)
+inline void reduce_uint(std::uint64_t *acc, std::uint64_t const *q, std::size_t count) {
+  while (acc[count] || util::is_greater_than_or_equal_uint(acc, q, count)) {
+    unsigned char borrow = 0;
+    for (std::size_t w = 0; w < count; w++) {
+      uint128_t diff = static_cast<uint128_t>(acc[w]) - q[w] - borrow;
+      acc[w] = static_cast<std::uint64_t>(diff);
+      borrow = static_cast<unsigned char>((diff >> 64) & 1);
+    }
+    acc[count] -= borrow;
+  }
+}
 
-  // CRT-compose the polynomial
-  context_data->rns_tool()->base_q()->compose_array(aCopy.get(), coeff_count, MemoryManager::GetPool());
+inline uint128_t to_uint128(std::uint64_t const *value, std::size_t count) {
+  return count > 1 ? (static_cast<uint128_t>(value[1]) << 64) | value[0] : value[0];
+}
 
-  long double two_pow_64 = powl(2.0, 64);
+// Shared setup of crt_compose and crt_compose_centered: calls write(i, value) with the composed
+// value (coeff_mod_count words in [0, q)) of every coefficient i, splitting the coefficients across threads
+template<typename Write>
+void crt_compose_each(util::ConstCoeffIter a, SEALContext::ContextData const* context_data, Write write) {
+  auto &coeff_modulus = context_data->parms().coeff_modulus();
+  size_t coeff_mod_count = coeff_modulus.size();
+  size_t coeff_count = context_data->parms().poly_modulus_degree();
+  auto base_q = context_data->rns_tool()->base_q();
+  auto punctured_prod = base_q->punctured_prod_array();
+  auto inv_punctured_prod = base_q->inv_punctured_prod_mod_base_array();
+  auto decryption_modulus = context_data->total_coeff_modulus();
 
-  for (std::size_t i = 0; i < coeff_count; i++) {
-    long double coeff = 0.0, cur_pow = 1.0;
-    if (util::is_greater_than_or_equal_uint(aCopy.get() + (i * coeff_mod_count),
-                                            upper_half_threshold, coeff_mod_count)) {
-      for (std::size_t j = 0; j < coeff_mod_count; j++, cur_pow *= two_pow_64) {
-        if (aCopy[i * coeff_mod_count + j] > decryption_modulus[j]) {
-          auto diff = aCopy[i * coeff_mod_count + j] - decryption_modulus[j];
-          coeff += diff ? static_cast<long double>(diff) * cur_pow : 0.0;
-        } else {
-          auto diff = decryption_modulus[j] - aCopy[i * coeff_mod_count + j];
-          coeff -= diff ? static_cast<long double>(diff) * cur_pow : 0.0;
+  if (coeff_mod_count == 1) {
+#pragma omp parallel for
+    for (size_t i = 0; i < coeff_count; i++) {
+      std::uint64_t value = a[i];
+      write(i, &value);
+    }
+  } else if (context_data->total_coeff_modulus_bit_count() < 128) {
+    // Everything fits into a native 128-bit integer, so there is no need for multiprecision arithmetic
+    uint128_t q = to_uint128(decryption_modulus, coeff_mod_count);
+    std::vector<uint128_t> punctured(coeff_mod_count);
+    for (size_t j = 0; j < coeff_mod_count; j++) {
+      punctured[j] = to_uint128(punctured_prod + (j * coeff_mod_count), coeff_mod_count);
+    }
+#pragma omp parallel
+    {
+      std::vector<std::uint64_t> value(coeff_mod_count, 0);
+#pragma omp for
+      for (size_t i = 0; i < coeff_count; i++) {
+        uint128_t acc = 0;
+        for (size_t j = 0; j < coeff_mod_count; j++) {
+          std::uint64_t y = util::multiply_uint_mod(a[i + (j * coeff_count)], inv_punctured_prod[j], coeff_modulus[j]);
+          acc += punctured[j] * y; // < q, so the sum of two terms is < 2q < 2^128
+          acc -= (acc >= q) ? q : 0;
         }
-      }
-    } else {
-      for (std::size_t j = 0; j < coeff_mod_count; j++, cur_pow *= two_pow_64) {
-        auto curr_coeff = aCopy[i * coeff_mod_count + j];
-        coeff += curr_coeff ? static_cast<long double>(curr_coeff) * cur_pow : 0.0;
+        value[0] = static_cast<std::uint64_t>(acc);
+        value[1] = static_cast<std::uint64_t>(acc >> 64);
+        write(i, value.data());
       }
     }
-
-    if (fabsl(coeff) > max) {
-      max = fabsl(coeff);
+  } else {
+#pragma omp parallel
+    {
+      std::vector<std::uint64_t> acc(coeff_mod_count + 1);
+#pragma omp for
+      for (size_t i = 0; i < coeff_count; i++) {
+        std::fill(acc.begin(), acc.end(), 0);
+        for (size_t j = 0; j < coeff_mod_count; j++) {
+          std::uint64_t y = util::multiply_uint_mod(a[i + (j * coeff_count)], inv_punctured_prod[j], coeff_modulus[j]);
+          multiply_add_uint(punctured_prod + (j * coeff_mod_count), coeff_mod_count, y, acc.data());
+        }
+        reduce_uint(acc.data(), decryption_modulus, coeff_mod_count);
+        write(i, acc.data());
+      }
     }
   }
+}
 
-  return max;
+} // namespace
+
+void crt_compose(util::ConstCoeffIter a, SEALContext::ContextData const* context_data, std::uint64_t* result) {
+  TraceScope scope("crt_compose", "kernel");
+  size_t coeff_mod_count = context_data->parms().coeff_modulus().size();
+  crt_compose_each(a, context_data, [&](size_t i, std::uint64_t const* value) {
+    std::copy_n(value, coeff_mod_count, result + (i * coeff_mod_count));
+  });
 }
 
-long double l2_norm(util::ConstCoeffIter a, SEALContext::ContextData const* context_data) {
-  auto &ciphertext_parms = context_data->parms();
-  auto &coeff_modulus = ciphertext_parms.coeff_modulus();
+void crt_decompose(std::uint64_t const* a, SEALContext::ContextData const* context_data, util::CoeffIter result) {
+  TraceScope scope("crt_decompose", "kernel");
+  auto &coeff_modulus = context_data->parms().coeff_modulus();
   size_t coeff_mod_count = coeff_modulus.size();
-  size_t coeff_count = ciphertext_parms.poly_modulus_degree();
+  size_t coeff_count = context_data->parms().poly_modulus_degree();
+#pragma omp parallel for
+  for (size_t i = 0; i < coeff_count; i++) {
+    for (size_t j = 0; j < coeff_mod_count; j++) {
+      result[i + (j * coeff_count)] = util::modulo_uint(a + (i * coeff_mod_count), coeff_mod_count, coeff_modulus[j]);
+    }
+  }
+}
+
+void crt_compose_centered(util::ConstCoeffIter a, SEALContext::ContextData const* context_data, long double* result) {
+  TraceScope scope("crt_compose_centered", "kernel");
+  size_t coeff_mod_count = context_data->parms().coeff_modulus().size();
   auto decryption_modulus = context_data->total_coeff_modulus();
   auto upper_half_threshold = context_data->upper_half_threshold();
-
-  long double sum = 0;
-
-  auto aCopy(util::allocate_zero_poly(coeff_count, coeff_mod_count, MemoryManager::GetPool()));
-  copy(a, coeff_count, coeff_mod_count, aCopy.get());
-
-  // CRT-compose the polynomial
-  context_data->rns_tool()->base_q()->compose_array(aCopy.get(), coeff_count, MemoryManager::GetPool());
-
   long double two_pow_64 = powl(2.0, 64);
 
-  for (std::size_t i = 0; i < coeff_count; i++) {
+  crt_compose_each(a, context_data, [&](size_t i, std::uint64_t const* value) {
+    bool negative = util::is_greater_than_or_equal_uint(value, upper_half_threshold, coeff_mod_count);
     long double coeff = 0.0, cur_pow = 1.0;
-    if (util::is_greater_than_or_equal_uint(aCopy.get() + (i * coeff_mod_count),
-                                            upper_half_threshold, coeff_mod_count)) {
-      for (std::size_t j = 0; j < coeff_mod_count; j++, cur_pow *= two_pow_64) {
-        if (aCopy[i * coeff_mod_count + j] > decryption_modulus[j]) {
-          auto diff = aCopy[i * coeff_mod_count + j] - decryption_modulus[j];
-          coeff += diff ? static_cast<long double>(diff) * cur_pow : 0.0;
-        } else {
-          auto diff = decryption_modulus[j] - aCopy[i * coeff_mod_count + j];
-          coeff -= diff ? static_cast<long double>(diff) * cur_pow : 0.0;
-        }
-      }
-    } else {
-      for (std::size_t j = 0; j < coeff_mod_count; j++, cur_pow *= two_pow_64) {
-        auto curr_coeff = aCopy[i * coeff_mod_count + j];
-        coeff += curr_coeff ? static_cast<long double>(curr_coeff) * cur_pow : 0.0;
+    unsigned char borrow = 0;
+    for (size_t j = 0; j < coeff_mod_count; j++, cur_pow *= two_pow_64) {
+      std::uint64_t word = value[j];
+      if (negative) {
+        // |value - q| = q - value, computed word by word
+        uint128_t diff = static_cast<uint128_t>(decryption_modulus[j]) - value[j] - borrow;
+        word = static_cast<std::uint64_t>(diff);
+        borrow = static_cast<unsigned char>((diff >> 64) & 1);
       }
+      coeff += word ? static_cast<long double>(word) * cur_pow : 0.0;
     }
+    result[i] = negative ? -coeff : coeff;
+  });
+}
 
-    sum += coeff * coeff;
+long double infty_norm(util::ConstCoeffIter a, SEALContext::ContextData const* context_data) {
+  TraceScope scope("infty_norm", "kernel");
+  size_t coeff_count = context_data->parms().poly_modulus_degree();
+  std::vector<long double> coeffs(coeff_count);
+  crt_compose_centered(a, context_data, coeffs.data());
+
+  long double max = 0;
+  for (auto coeff : coeffs) {
+    if (fabsl(coeff) > max) {
+      max = fabsl(coeff);
+    }
   }
+  return max;
+}
+
+long double l2_norm(util::ConstCoeffIter a, SEALContext::ContextData const* context_data) {
+  TraceScope scope("l2_norm", "kernel");
+  size_t coeff_count = context_data->parms().poly_modulus_degree();
+  std::vector<long double> coeffs(coeff_count);
+  crt_compose_centered(a, context_data, coeffs.data());
 
+  long double sum = 0;
+  for (auto coeff : coeffs) {
+    sum += coeff * coeff;
+  }
   return sqrtl(sum);
 }
 
@@ -276,8 +473,110 @@ void evalPlainPowerOf2(std::vector<cx_double> & res, std::vector<cx_double> cons
   }
 }
 
+void toSoaVector(soa_cx_vector& res, std::vector<cx_double> const& in) {
+  size_t len = in.size();
+  res.resize(len);
+  double* re = res.re.data();
+  double* im = res.im.data();
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    re[i] = in[i].real();
+    im[i] = in[i].imag();
+  }
+}
+
+void toSoaVector(soa_cx_vector& res, std::vector<double> const& in) {
+  res.re.assign(in.begin(), in.end());
+  res.im.assign(in.size(), 0.0);
+}
+
+void toComplexVector(std::vector<cx_double>& res, soa_cx_vector const& in) {
+  size_t len = in.size();
+  res.resize(len);
+  double const* re = in.re.data();
+  double const* im = in.im.data();
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    res[i] = cx_double(re[i], im[i]);
+  }
+}
+
+// The soa_cx_vector versions take the raw pointers only after resizing res, so that res may alias an input.
+// Every iteration reads and writes the same index only, hence the loops are safe to vectorise.
+
+void evalPlainAdd(soa_cx_vector& res, soa_cx_vector const& in0, soa_cx_vector const& in1) {
+  size_t len = std::min(in0.size(), in1.size());
+  res.resize(len);
+  double const *a_re = in0.re.data(), *a_im = in0.im.data();
+  double const *b_re = in1.re.data(), *b_im = in1.im.data();
+  double *r_re = res.re.data(), *r_im = res.im.data();
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    r_re[i] = a_re[i] + b_re[i];
+    r_im[i] = a_im[i] + b_im[i];
+  }
+}
+
+void evalPlainMul(soa_cx_vector& res, soa_cx_vector const& in0, soa_cx_vector const& in1) {
+  size_t len = std::min(in0.size(), in1.size());
+  res.resize(len);
+  double const *a_re = in0.re.data(), *a_im = in0.im.data();
+  double const *b_re = in1.re.data(), *b_im = in1.im.data();
+  double *r_re = res.re.data(), *r_im = res.im.data();
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    double re = a_re[i] * b_re[i] - a_im[i] * b_im[i];
+    double im = a_re[i] * b_im[i] + a_im[i] * b_re[i];
+    r_re[i] = re;
+    r_im[i] = im;
+  }
+}
+
+void evalPlainNegate(soa_cx_vector& res, soa_cx_vector const& in) {
+  size_t len = in.size();
+  res.resize(len);
+  double const *a_re = in.re.data(), *a_im = in.im.data();
+  double *r_re = res.re.data(), *r_im = res.im.data();
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    r_re[i] = -a_re[i];
+    r_im[i] = -a_im[i];
+  }
+}
 
+void evalPlainInverse(soa_cx_vector& res, soa_cx_vector const& in) {
+  size_t len = in.size();
+  res.resize(len);
+  double const *a_re = in.re.data(), *a_im = in.im.data();
+  double *r_re = res.re.data(), *r_im = res.im.data();
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    // 1/(a+bi) = (a-bi)/(a^2+b^2)
+    double inv_norm = 1.0 / (a_re[i] * a_re[i] + a_im[i] * a_im[i]);
+    double re = a_re[i] * inv_norm;
+    double im = -a_im[i] * inv_norm;
+    r_re[i] = re;
+    r_im[i] = im;
+  }
+}
 
+void evalPlainPowerOf2(soa_cx_vector& res, soa_cx_vector const& in, size_t logDeg) {
+  size_t len = in.size();
+  res.resize(len);
+  double const *a_re = in.re.data(), *a_im = in.im.data();
+  double *r_re = res.re.data(), *r_im = res.im.data();
+#pragma omp simd
+  for (size_t i = 0; i < len; i++) {
+    double re = a_re[i], im = a_im[i];
+    for (size_t j = 0; j < logDeg; j++) {
+      double sq_re = re * re - im * im;
+      im = 2.0 * re * im;
+      re = sq_re;
+    }
+    r_re[i] = re;
+    r_im[i] = im;
+  }
+}
 
 double largestElm(std::vector<std::complex<double>> const& vec) {
   double m = 0;
@@ -290,78 +589,234 @@ double largestElm(std::vector<std::complex<double>> const& vec) {
   return m;
 }
 
+ErrorMetrics errorMetrics(cx_double const* in0, cx_double const* in1, size_t len) {
+  TraceScope scope("errorMetrics", "kernel");
+  // std::complex<double> is layout-compatible with double[2], so scan both inputs as flat arrays of doubles
+  auto a = reinterpret_cast<double const*>(in0);
+  auto b = reinterpret_cast<double const*>(in1);
+  double max_abs = 0, max_rel = 0, sum_sq = 0;
+#pragma omp simd reduction(max:max_abs, max_rel) reduction(+:sum_sq)
+  for (size_t i = 0; i < 2 * len; i++) {
+    double diff = a[i] - b[i];
+    double abs_diff = std::fabs(diff);
+    double rel = std::fabs(diff / b[i]);
+    max_abs = abs_diff > max_abs ? abs_diff : max_abs;
+    max_rel = rel > max_rel ? rel : max_rel; // 0/0 is NaN and never counts
+    sum_sq += diff * diff;
+  }
+
+  ErrorMetrics metrics;
+  metrics.max_abs = max_abs;
+  metrics.max_rel = max_rel;
+  metrics.rms = len ? std::sqrt(sum_sq / static_cast<double>(len)) : 0.0;
+  metrics.precision_bits = -std::log2(max_abs);
+  return metrics;
+}
+
+ErrorMetrics errorMetrics(std::vector<cx_double> const& in0, std::vector<cx_double> const& in1) {
+  return errorMetrics(in0.data(), in1.data(), std::min(in0.size(), in1.size()));
+}
+
 double maxDiff(std::vector<cx_double> const& in0, std::vector<cx_double> const& in1) {
-  size_t len = std::min(in0.size(), in1.size());
-  std::vector<cx_double> tmp(len);
-  evalPlainNegate(tmp, in1);
-  evalPlainAdd(tmp, in0, tmp);
-  return largestElm(tmp);
+  return errorMetrics(in0, in1).max_abs;
 }
 
 double relError(std::vector<cx_double> const& in0, std::vector<cx_double> const& in1) {
-  size_t len = std::min(in0.size(), in1.size());
-  std::vector<cx_double> diff(len);
-  evalPlainNegate(diff, in1);
-  evalPlainAdd(diff, diff, in0);
-  double res = 0;
+  return errorMetrics(in0, in1).max_rel;
+}
+
+PrecisionReport::PrecisionReport() : histogram_((max_bits - min_bits) * bins_per_bit, 0) {}
+
+void PrecisionReport::record(double bits) {
+  double bin = (bits - min_bits) * bins_per_bit; // +inf for exact slots, which land in the top bin
+  bin = bin > 0.0 ? std::min(bin, static_cast<double>(histogram_.size() - 1)) : 0.0;
+  histogram_[static_cast<size_t>(bin)]++;
+  worst_ = bits < worst_ ? bits : worst_;
+}
+
+void PrecisionReport::add(cx_double const* result, cx_double const* expected, size_t len) {
   for (size_t i = 0; i < len; i++) {
-    double tmp = std::fabs(diff[i].real() / in1[i].real());
-    if (res < tmp) {
-      res = tmp;
-    }
-    tmp = std::fabs(diff[i].imag() / in1[i].imag());
-    if (res < tmp) {
-      res = tmp;
+    record(-std::log2(std::max(std::fabs(result[i].real() - expected[i].real()),
+                               std::fabs(result[i].imag() - expected[i].imag()))));
+  }
+  count_ += len;
+}
+
+void PrecisionReport::add(std::vector<cx_double> const& result, std::vector<cx_double> const& expected) {
+  add(result.data(), expected.data(), std::min(result.size(), expected.size()));
+}
+
+void PrecisionReport::add(std::vector<double> const& result, double expected) {
+  for (auto x : result) {
+    record(-std::log2(std::fabs(x - expected)));
+  }
+  count_ += result.size();
+}
+
+void PrecisionReport::merge(PrecisionReport const& other) {
+  for (size_t i = 0; i < histogram_.size(); i++) {
+    histogram_[i] += other.histogram_[i];
+  }
+  count_ += other.count_;
+  worst_ = std::min(worst_, other.worst_);
+}
+
+double PrecisionReport::quantile(double q) const {
+  if (count_ == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  if (q >= 1.0) {
+    return worst_;
+  }
+  // Walk from the most precise bin down until a fraction q of all slots is covered; report the bin's lower edge
+  auto needed = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(count_)));
+  std::uint64_t seen = 0;
+  for (size_t i = histogram_.size(); i-- > 0;) {
+    seen += histogram_[i];
+    if (seen >= needed) {
+      return std::max(worst_, static_cast<double>(i) / bins_per_bit + min_bits);
     }
   }
-  return res;
+  return worst_;
 }
 
-void randomComplexVector(std::vector<cx_double>& array, size_t n, double rad) {
+void PrecisionReport::print(std::ostream& os) const {
+  std::ios old_fmt(nullptr);
+  old_fmt.copyfmt(os);
+  os << std::fixed << std::setprecision(2)
+     << "precision over " << count_ << " slots (bits): p50 " << quantile(0.5) << ", p90 " << quantile(0.9)
+     << ", p99 " << quantile(0.99) << ", max error " << quantile(1.0) << std::endl;
+  os.copyfmt(old_fmt);
+}
+
+void randomUniform(double* out, size_t n, std::uint64_t seed, std::uint64_t stream, std::uint64_t offset) {
+  Philox4x32 gen(seed, stream);
+#pragma omp parallel for simd
+  for (size_t i = 0; i < n; i++) {
+    std::uint64_t r0, r1;
+    gen.block(offset + i, r0, r1);
+    out[i] = Philox4x32::to_unit(r0);
+  }
+}
+
+void randomGaussian(double* out, size_t n, double stddev, std::uint64_t seed, std::uint64_t stream,
+                    std::uint64_t offset) {
+  Philox4x32 gen(seed, stream);
+#pragma omp parallel for simd
+  for (size_t i = 0; i < n; i++) {
+    std::uint64_t r0, r1;
+    gen.block(offset + i, r0, r1);
+    double u = 1.0 - Philox4x32::to_unit(r0); // (0, 1], so the log is finite
+    out[i] = stddev * std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * M_PI * Philox4x32::to_unit(r1));
+  }
+}
+
+void randomPolar(cx_double* out, size_t n, double rad, std::uint64_t seed, std::uint64_t stream,
+                 std::uint64_t offset) {
+  Philox4x32 gen(seed, stream);
+#pragma omp parallel for
+  for (size_t i = 0; i < n; i++) {
+    std::uint64_t r0, r1;
+    gen.block(offset + i, r0, r1);
+    double r = rad * std::sqrt(Philox4x32::to_unit(r0)); // sqrt(uniform[0,1]) gives a uniform point on the disk
+    double theta = 2.0 * M_PI * Philox4x32::to_unit(r1);
+    out[i] = std::polar(r, theta);
+  }
+}
+
+namespace {
+
+// Streams handed out to the generators without an explicit seed, so that concurrent calls never overlap
+std::uint64_t next_random_stream() {
+  static std::atomic<std::uint64_t> stream(0);
+  return stream++;
+}
+
+} // namespace
+
+void randomComplexVector(cx_double* out, size_t n, double rad, std::uint64_t seed, std::uint64_t stream,
+                         std::uint64_t offset) {
   if (rad <= 0) {
     rad = 1.0;                // default radius = 1
   }
-  array.resize(n);             // allocate space
-  for (auto& x : array) {
-    long bits = std::rand();         // 32 random bits
-    double r = std::sqrt(bits & 0xffff) / 256.0; // sqrt(uniform[0,1])
-    double theta =
-        2.0L * M_PI * ((bits >> 16) & 0xffff) / 65536.0; // uniform(0,2pi)
-    x = std::polar(rad * r, theta);
+  randomPolar(out, n, rad, seed, stream, offset);
+}
+
+void randomRealVector(cx_double* out, size_t n, double B, std::uint64_t seed, std::uint64_t stream,
+                      std::uint64_t offset) {
+  B = fabs(B);
+  Philox4x32 gen(seed, stream);
+#pragma omp parallel for
+  for (size_t i = 0; i < n; i++) {
+    std::uint64_t r0, r1;
+    gen.block(offset + i, r0, r1);
+    double r = std::sqrt(Philox4x32::to_unit(r0)); // sqrt(uniform[0,1])
+    double sign = (r1 >> 63) ? 1.0 : -1.0;
+    out[i] = cx_double(B * r * sign, 0.0);
   }
 }
 
+void randomComplexVector(std::vector<cx_double>& array, size_t n, double rad) {
+  randomComplexVector(array, n, rad, default_random_seed, next_random_stream());
+}
+
+void randomComplexVector(std::vector<cx_double>& array, size_t n, double rad, std::uint64_t seed,
+                         std::uint64_t stream) {
+  array.resize(n);             // allocate space
+  randomComplexVector(array.data(), n, rad, seed, stream);
+}
+
 cx_double * randomComplexVector(size_t n, double rad) {
-  std::vector<cx_double> vec(n);
   cx_double * pvec = new cx_double[n];
-  randomComplexVector(vec, n, rad);
-  for (size_t i = 0; i < n; i++) {
-    pvec[i] = vec[i];
-  }
+  randomComplexVector(pvec, n, rad, default_random_seed, next_random_stream());
   return pvec;
 }
 
 void randomRealVector(std::vector<cx_double>& array, size_t n, double B) {
-  B = fabs(B);
+  randomRealVector(array, n, B, default_random_seed, next_random_stream());
+}
+
+void randomRealVector(std::vector<cx_double>& array, size_t n, double B, std::uint64_t seed, std::uint64_t stream) {
   array.resize(n);             // allocate space
-  for (auto& x : array) {
-    long bits = std::rand();         // 32 random bits
-    double r = std::sqrt(bits & 0xffff) / 256.0; // sqrt(uniform[0,1])
-    double sign = ((bits >> 16) & 0xffff) > 32767 ? 1.0 : -1.0;
-    x.real(B * r * sign);
-    x.imag(0);
-  }
+  randomRealVector(array.data(), n, B, seed, stream);
 }
+
 cx_double * randomRealVector(size_t n, double rad) {
-  std::vector<cx_double> vec(n);
   cx_double * pvec = new cx_double[n];
-  randomRealVector(vec, n, rad);
-  for (size_t i = 0; i < n; i++) {
-    pvec[i] = vec[i];
-  }
+  randomRealVector(pvec, n, rad, default_random_seed, next_random_stream());
   return pvec;
 }
 
+RandomDataset::RandomDataset(std::uint64_t total, std::size_t chunk_size, double bound, sample_type type,
+                             std::uint64_t seed, std::uint64_t stream)
+    : total_(total), chunk_size_(chunk_size), bound_(bound), type_(type), seed_(seed), stream_(stream) {
+  if (chunk_size == 0) {
+    throw std::invalid_argument("chunk_size must be positive");
+  }
+}
+
+std::size_t RandomDataset::chunk(std::uint64_t index, cx_double* out) const {
+  if (index >= chunk_count()) {
+    return 0;
+  }
+  std::uint64_t offset = index * chunk_size_;
+  auto len = static_cast<std::size_t>(std::min<std::uint64_t>(chunk_size_, total_ - offset));
+  if (type_ == sample_type::complex) {
+    randomComplexVector(out, len, bound_, seed_, stream_, offset);
+  } else {
+    randomRealVector(out, len, bound_, seed_, stream_, offset);
+  }
+  return len;
+}
+
+bool RandomDataset::next(std::vector<cx_double>& out) {
+  if (next_ >= chunk_count()) {
+    return false;
+  }
+  out.resize(static_cast<std::size_t>(std::min<std::uint64_t>(chunk_size_, total_ - next_ * chunk_size_)));
+  return next(out.data()) > 0;
+}
+
 
 void copyTo(std::complex<double> * dst, std::complex<double> const* src, size_t len) {
   for (size_t i = 0; i < len; i++) {
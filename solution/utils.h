@@ -12,6 +12,7 @@
 #include <limits>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <numeric>
 #include <random>
 #include <sstream>
@@ -25,12 +26,185 @@
 
 typedef std::complex<double> cx_double;
 
+/// Allocator returning memory aligned to Alignment bytes (by default a cache line, enough for AVX-512 loads)
+template<typename T, std::size_t Alignment = 64>
+struct aligned_allocator {
+  typedef T value_type;
+  template<typename U>
+  struct rebind { typedef aligned_allocator<U, Alignment> other; };
+
+  aligned_allocator() = default;
+  template<typename U>
+  aligned_allocator(aligned_allocator<U, Alignment> const &) {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+  void deallocate(T *p, std::size_t) {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template<typename U>
+  bool operator==(aligned_allocator<U, Alignment> const &) const { return true; }
+  template<typename U>
+  bool operator!=(aligned_allocator<U, Alignment> const &) const { return false; }
+};
+
+/// Complex vector stored as two aligned arrays of real and imaginary parts (structure of arrays).
+/// The evalPlain* overloads on this type compile to straight SIMD loops, unlike std::vector<cx_double>.
+struct soa_cx_vector {
+  std::vector<double, aligned_allocator<double>> re;
+  std::vector<double, aligned_allocator<double>> im;
+
+  size_t size() const { return re.size(); }
+  void resize(size_t n) {
+    re.resize(n);
+    im.resize(n);
+  }
+};
+
+/// Convert a vector as taken by CKKSEncoder::encode / returned by CKKSEncoder::decode into a soa_cx_vector
+void toSoaVector(soa_cx_vector &res, std::vector<cx_double> const &in);
+
+/// Convert a real vector as taken by CKKSEncoder::encode / returned by CKKSEncoder::decode into a soa_cx_vector
+void toSoaVector(soa_cx_vector &res, std::vector<double> const &in);
+
+/// Convert a soa_cx_vector back into a vector that can be passed to CKKSEncoder::encode
+void toComplexVector(std::vector<cx_double> &res, soa_cx_vector const &in);
+
+/// Counter-based Philox4x32-10 generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+/// Block i of a stream is a pure function of (seed, stream, i): there is no state to share or lock, and any split of
+/// the counters across threads produces exactly the same numbers.
+class Philox4x32 {
+ public:
+  explicit Philox4x32(std::uint64_t seed, std::uint64_t stream = 0)
+      : key0_(static_cast<std::uint32_t>(seed)), key1_(static_cast<std::uint32_t>(seed >> 32)),
+        stream0_(static_cast<std::uint32_t>(stream)), stream1_(static_cast<std::uint32_t>(stream >> 32)) {}
+
+  /// The 128 random bits at position counter of this stream, as two 64-bit words
+  void block(std::uint64_t counter, std::uint64_t &out0, std::uint64_t &out1) const {
+    std::uint32_t c0 = static_cast<std::uint32_t>(counter), c1 = static_cast<std::uint32_t>(counter >> 32);
+    std::uint32_t c2 = stream0_, c3 = stream1_;
+    std::uint32_t k0 = key0_, k1 = key1_;
+    for (int round = 0; round < 10; round++) {
+      std::uint64_t p0 = std::uint64_t(0xD2511F53) * c0;
+      std::uint64_t p1 = std::uint64_t(0xCD9E8D57) * c2;
+      c0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      c1 = static_cast<std::uint32_t>(p1);
+      c2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c3 = static_cast<std::uint32_t>(p0);
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    out0 = (std::uint64_t(c1) << 32) | c0;
+    out1 = (std::uint64_t(c3) << 32) | c2;
+  }
+
+  /// Map 64 random bits to a double uniform in [0, 1) (53 bits of precision)
+  static double to_unit(std::uint64_t bits) { return static_cast<double>(bits >> 11) * 0x1.0p-53; }
+
+ private:
+  std::uint32_t key0_, key1_, stream0_, stream1_;
+};
+
+/// Seed used by the generators that do not take an explicit seed
+constexpr std::uint64_t default_random_seed = 0x5EA1CC55DEADBEEF;
+
+/// Fill out[i] with a double uniform in [0, 1); out[i] only depends on (seed, stream, offset + i)
+void randomUniform(double *out, size_t n, std::uint64_t seed, std::uint64_t stream = 0, std::uint64_t offset = 0);
+
+/// Fill out[i] with a normally distributed double of mean 0 and standard deviation stddev (Box-Muller);
+/// out[i] only depends on (seed, stream, offset + i)
+void randomGaussian(double *out, size_t n, double stddev, std::uint64_t seed, std::uint64_t stream = 0,
+                    std::uint64_t offset = 0);
+
+/// Fill out[i] with a complex number uniform on the disk of radius rad; out[i] only depends on (seed, stream, offset + i)
+void randomPolar(cx_double *out, size_t n, double rad, std::uint64_t seed, std::uint64_t stream = 0,
+                 std::uint64_t offset = 0);
+
+/// Fill a caller-provided buffer in place with complex numbers uniform on the disk of radius rad
+/// \param out Buffer of at least n values
+/// \param n Number of values to generate
+/// \param rad Radius (distance from origin of complex number plane) the complex numbers should have
+/// \param seed Seed of the generator
+/// \param stream Stream of the generator
+/// \param offset Position in the stream of out[0], so that a long sequence can be generated piece by piece
+void randomComplexVector(cx_double *out, size_t n, double rad, std::uint64_t seed, std::uint64_t stream,
+                         std::uint64_t offset = 0);
+
+/// Fill a caller-provided buffer in place with real numbers in [-B, B] (imaginary part 0), see above
+void randomRealVector(cx_double *out, size_t n, double B, std::uint64_t seed, std::uint64_t stream,
+                      std::uint64_t offset = 0);
+
 /// Generate a random vector of complex numbers with a given size
+/// Thread-safe: every call draws from a fresh stream of default_random_seed.
 /// \param array Vector to store results into
 /// \param n    Size of vector
 /// \param rad  Radius (distance from origin of complex number plane) the complex numbers should have
 void randomComplexVector(std::vector<cx_double> &array, size_t n, double rad = 1.0);
 
+/// Generate a reproducible random vector of complex numbers with a given size
+/// \param array Vector to store results into
+/// \param n    Size of vector
+/// \param rad  Radius (distance from origin of complex number plane) the complex numbers should have
+/// \param seed Seed of the generator
+/// \param stream Stream of the generator, e.g. the index of the trial or of the thread
+void randomComplexVector(std::vector<cx_double> &array, size_t n, double rad, std::uint64_t seed,
+                         std::uint64_t stream);
+
+/// Generate a random vector of real numbers in [-B, B] (stored as complex numbers with imaginary part 0)
+/// Thread-safe: every call draws from a fresh stream of default_random_seed.
+void randomRealVector(std::vector<cx_double> &array, size_t n, double B = 1.0);
+
+/// Generate a reproducible random vector of real numbers in [-B, B], see randomComplexVector
+void randomRealVector(std::vector<cx_double> &array, size_t n, double B, std::uint64_t seed, std::uint64_t stream);
+
+/// Kind of values produced by RandomDataset
+enum class sample_type { complex, real };
+
+/// Streams an arbitrarily large random dataset in chunks (e.g., of slot_count values, ready to be encoded) without
+/// ever holding more than the chunk the caller provides. Chunk i only depends on (seed, stream, i), so chunks can
+/// also be produced out of order or by several threads at once via chunk().
+class RandomDataset {
+ public:
+  /// \param total Total number of values in the dataset
+  /// \param chunk_size Number of values per chunk (the last chunk may be shorter)
+  /// \param bound Radius of the complex values, or bound B of the real values in [-B, B]
+  /// \param type Whether to generate complex or real values
+  /// \param seed Seed of the generator
+  /// \param stream Stream of the generator
+  RandomDataset(std::uint64_t total, std::size_t chunk_size, double bound = 1.0,
+                sample_type type = sample_type::complex, std::uint64_t seed = default_random_seed,
+                std::uint64_t stream = 0);
+
+  /// Number of chunks in the dataset
+  std::uint64_t chunk_count() const { return (total_ + chunk_size_ - 1) / chunk_size_; }
+
+  /// Write chunk index into out (at least chunk_size values)
+  /// \return Number of values written, 0 if index is past the end
+  std::size_t chunk(std::uint64_t index, cx_double *out) const;
+
+  /// Write the next chunk into out (at least chunk_size values)
+  /// \return Number of values written, 0 once the dataset is exhausted
+  std::size_t next(cx_double *out) { return chunk(next_++, out); }
+
+  /// Write the next chunk into a vector, resized to the length of the chunk (which keeps its capacity)
+  /// \return false once the dataset is exhausted
+  bool next(std::vector<cx_double> &out);
+
+  /// Start again from the first chunk
+  void reset() { next_ = 0; }
+
+ private:
+  std::uint64_t total_;
+  std::size_t chunk_size_;
+  double bound_;
+  sample_type type_;
+  std::uint64_t seed_;
+  std::uint64_t stream_;
+  std::uint64_t next_ = 0;
+};
+
 /// Find the largest element of a vector
 double largestElm(std::vector<cx_double> const &vec);
 
@@ -40,6 +214,88 @@ double maxDiff(std::vector<cx_double> const &in0, std::vector<cx_double> const &
 /// Find the relative error (in0-in1)/in1 between two vectors in0 and in1
 double relError(std::vector<cx_double> const &in0, std::vector<cx_double> const &in1);
 
+/// Plaintext reference evaluation: res = in0 + in1 (slot-wise, over the common length)
+void evalPlainAdd(std::vector<cx_double> &res, std::vector<cx_double> const &in0, std::vector<cx_double> const &in1);
+void evalPlainAdd(soa_cx_vector &res, soa_cx_vector const &in0, soa_cx_vector const &in1);
+
+/// Plaintext reference evaluation: res = in0 * in1 (slot-wise, over the common length)
+void evalPlainMul(std::vector<cx_double> &res, std::vector<cx_double> const &in0, std::vector<cx_double> const &in1);
+void evalPlainMul(soa_cx_vector &res, soa_cx_vector const &in0, soa_cx_vector const &in1);
+
+/// Plaintext reference evaluation: res = -in
+void evalPlainNegate(std::vector<cx_double> &res, std::vector<cx_double> const &in);
+void evalPlainNegate(soa_cx_vector &res, soa_cx_vector const &in);
+
+/// Plaintext reference evaluation: res = 1 / in
+void evalPlainInverse(std::vector<cx_double> &res, std::vector<cx_double> const &in);
+void evalPlainInverse(soa_cx_vector &res, soa_cx_vector const &in);
+
+/// Plaintext reference evaluation: res = in^(2^logDeg), by repeated squaring
+void evalPlainPowerOf2(std::vector<cx_double> &res, std::vector<cx_double> const &in, size_t logDeg);
+void evalPlainPowerOf2(soa_cx_vector &res, soa_cx_vector const &in, size_t logDeg);
+
+/// Error of an approximate result in0 against the expected values in1
+struct ErrorMetrics {
+  double max_abs = 0;        ///< largest |in0 - in1| over all real and imaginary parts (= maxDiff)
+  double max_rel = 0;        ///< largest |(in0 - in1) / in1| over all real and imaginary parts (= relError)
+  double rms = 0;            ///< root mean square of |in0 - in1| over all slots
+  double precision_bits = 0; ///< -log2(max_abs), i.e. the number of correct bits after the binary point
+};
+
+/// Compute all error metrics of in0 against in1 in a single pass, without allocating
+/// \param in0 Approximate values (e.g., decrypted and decoded result)
+/// \param in1 Expected values
+/// \param len Number of slots to compare
+ErrorMetrics errorMetrics(cx_double const *in0, cx_double const *in1, size_t len);
+
+/// Compute all error metrics of in0 against in1 over their common length
+ErrorMetrics errorMetrics(std::vector<cx_double> const &in0, std::vector<cx_double> const &in1);
+
+/// Streaming distribution of the bits of precision -log2|result - expected| of every slot, accumulated over any
+/// number of decryptions. The error of a slot is the larger one of its real and imaginary part (as in maxDiff).
+/// Samples are counted in a fixed histogram with 1/16 bit resolution, so memory stays bounded however many slots and
+/// runs are added and the quantiles are exact up to the bin width. Not thread-safe: use one report per thread and merge.
+class PrecisionReport {
+ public:
+  PrecisionReport();
+
+  /// Add the slots of one decoded result
+  /// \param result Decoded values
+  /// \param expected Values the computation should have produced
+  /// \param len Number of slots to add
+  void add(cx_double const *result, cx_double const *expected, size_t len);
+
+  /// Add the slots of one decoded result, over the common length of result and expected
+  void add(std::vector<cx_double> const &result, std::vector<cx_double> const &expected);
+
+  /// Add the slots of one decoded real result where every slot should hold the same value
+  void add(std::vector<double> const &result, double expected);
+
+  /// Add all samples of another report (e.g., from another thread)
+  void merge(PrecisionReport const &other);
+
+  /// Precision in bits that a fraction q of all slots reaches or exceeds, e.g. q = 0.99 gives the p99 error.
+  /// q = 1 returns the exact worst case.
+  double quantile(double q) const;
+
+  /// Number of slots added so far
+  std::uint64_t count() const { return count_; }
+
+  /// Print p50/p90/p99/max error (in bits of precision) as a single line
+  void print(std::ostream &os = std::cout) const;
+
+ private:
+  static constexpr int min_bits = -16;
+  static constexpr int max_bits = 64;
+  static constexpr int bins_per_bit = 16;
+
+  void record(double bits);
+
+  std::vector<std::uint64_t> histogram_;
+  std::uint64_t count_ = 0;
+  double worst_ = std::numeric_limits<double>::infinity();
+};
+
 /// Datatype for a seal polynomial. Due to what seems to be a bug in SEAL, these cannot be assigned or copied with =
 typedef seal::util::CoeffIter seal_polynomial;
 
@@ -74,6 +330,27 @@ void to_coeff_rep(seal_polynomial a,
                   size_t coeff_modulus_count,
                   seal::util::NTTTables const *small_ntt_tables);
 
+/// CRT-compose a polynomial into multiprecision integers in [0, q). The coefficients are split across threads, and
+/// when q fits into 128 bits the composition uses native 128-bit arithmetic instead of multiprecision arithmetic.
+/// \param a element to compose (must be in standard coefficient representation)
+/// \param context_data special helper (get via context.get_context_data(ctxt.parms_id()))
+/// \param result Array of coeff_count * coeff_modulus.size() words; coefficient i is stored little-endian in
+///               words [i * coeff_modulus.size(), (i + 1) * coeff_modulus.size()), just like RNSBase::compose_array
+void crt_compose(const_seal_polynomial a, seal::SEALContext::ContextData const *context_data, std::uint64_t *result);
+
+/// Inverse of crt_compose: reduce multiprecision coefficients modulo every q_i
+/// \param a Array of coeff_count * coeff_modulus.size() words in the layout produced by crt_compose
+/// \param context_data special helper (get via context.get_context_data(ctxt.parms_id()))
+/// \param result Element to store result in
+void crt_decompose(std::uint64_t const *a, seal::SEALContext::ContextData const *context_data, seal_polynomial result);
+
+/// CRT-compose a polynomial and lift every coefficient to its centered representative in (-q/2, q/2]
+/// \param a element to compose (must be in standard coefficient representation)
+/// \param context_data special helper (get via context.get_context_data(ctxt.parms_id()))
+/// \param result Array of coeff_count values to store result in
+void crt_compose_centered(const_seal_polynomial a, seal::SEALContext::ContextData const *context_data,
+                          long double *result);
+
 /// Infinity norm of a polynomial (must be in standard coefficient representation)
 long double infty_norm(const_seal_polynomial a, seal::SEALContext::ContextData const *context_data);
 
@@ -104,6 +381,29 @@ void sub(const_seal_polynomial a, const_seal_polynomial b,
          std::size_t coeff_count, std::vector<seal::Modulus> const &coeff_modulus,
          seal_polynomial result);
 
+/// Apply the Galois automorphism X -> X^galois_elt to a polynomial, without any key switching.
+/// Works on both representations; the index/sign tables for each (coeff_count, galois_elt) pair
+/// are built on first use and cached, so repeated calls are a single gather per q_i.
+/// \param a element to transform (must not overlap with result)
+/// \param coeff_count The number of coefficients in the polynomial (i.e., poly_modulus_degree)
+/// \param coeff_modulus The coefficient modulus q
+/// \param galois_elt Odd integer in [1, 2*coeff_count) (get via context_data->galois_tool()->get_elt_from_step(step))
+/// \param ntt_form true if a is in eval_rep form, false if it is in standard coefficient representation
+/// \param result Element to store result in
+void apply_galois(const_seal_polynomial a, std::size_t coeff_count, std::vector<seal::Modulus> const &coeff_modulus,
+                  std::uint32_t galois_elt, bool ntt_form, seal_polynomial result);
+
+/// Apply several Galois automorphisms to the same polynomial
+/// \param a element to transform (must not overlap with results)
+/// \param coeff_count The number of coefficients in the polynomial (i.e., poly_modulus_degree)
+/// \param coeff_modulus The coefficient modulus q
+/// \param galois_elts The Galois elements to apply, see apply_galois
+/// \param ntt_form true if a is in eval_rep form, false if it is in standard coefficient representation
+/// \param results galois_elts.size() polynomials stored back to back, results[i] = a(X^galois_elts[i])
+void apply_galois_many(const_seal_polynomial a, std::size_t coeff_count,
+                       std::vector<seal::Modulus> const &coeff_modulus,
+                       std::vector<std::uint32_t> const &galois_elts, bool ntt_form, seal_polynomial results);
+
 /*
  * Helper function: Allows using a vector in std::cout << some_vector std::endl;
  */